@@ -24,14 +24,15 @@ const char *json = "{"
 
 
 void print_token(jsnntok_t *t, const char *js) {
-    printf("%.*s\n", t->end - t->start, js + t->start);
+    printf("%.*s\n", (int)(t->end - t->start), js + t->start);
 }
 
 int main(int argc, char **argv) {
     int i;
     jsnn_parser parser;
     jsnntok_t tokens[256];
-    jsnntok_t *cats, *dogs, *cat, *dog, *name, *breed;
+    jsnntok_t *cats, *dogs, *cat, *dog, *name, *breed, *names[16];
+    int n;
     char path[256];
 
     // Parse the json!
@@ -49,6 +50,11 @@ int main(int argc, char **argv) {
         print_token(breed, json);
     }
 
+    printf("all names:\n");
+    n = jsnn_query(tokens, "..name", json, tokens, names, 16);
+    for (i = 0; i < n; i++)
+        print_token(names[i], json);
+
     printf("dogs:\n");
     dogs = jsnn_get(tokens, "dogs", json, tokens);
     for (i = 0; i < dogs->size; i++) {
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -18,6 +19,7 @@ static jsnntok_t *jsnn_alloc_token(jsnn_parser *parser,
 	tok->start = tok->end = -1;
 	tok->size = 0;
 	tok->parent = -1;
+	tok->key = -1;
 	return tok;
 }
 
@@ -25,7 +27,7 @@ static jsnntok_t *jsnn_alloc_token(jsnn_parser *parser,
  * Fills token type and boundaries.
  */
 static void jsnn_fill_token(jsnntok_t *token, jsnntype_t type, 
-                            jsnnpair_t pair_type, int start, int end) {
+                            jsnnpair_t pair_type, jsnnint_t start, jsnnint_t end) {
 	token->type = type;
     token->pair_type = pair_type;
 	token->start = start;
@@ -37,13 +39,13 @@ static void jsnn_fill_token(jsnntok_t *token, jsnntype_t type,
  * Fills next available token with JSON primitive.
  */
 static jsnnerr_t jsnn_parse_primitive(jsnn_parser *parser, const char *js,
-		jsnntok_t *tokens, size_t num_tokens) {
+		jsnnuint_t len, jsnntok_t *tokens, size_t num_tokens) {
 	jsnntok_t *token;
-	int start;
+	jsnnint_t start;
 
 	start = parser->pos;
 
-	for (; js[parser->pos] != '\0'; parser->pos++) {
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		switch (js[parser->pos]) {
 #ifndef JSNN_STRICT
 			/* In strict mode primitive must be followed by "," or "}" or "]" */
@@ -76,19 +78,82 @@ found:
 	return JSNN_SUCCESS;
 }
 
+#define JSNN_HASH_INIT 2166136261u
+#define JSNN_HASH_STEP(h, c) (((h) ^ (unsigned char)(c)) * 16777619u)
+
+static
+int jsnn_intern_probe(const jsnn_intern *table, const char *key, int len,
+        unsigned int hash) {
+    unsigned int mask = table->num_entries - 1, i;
+    jsnn_intern_entry *e;
+
+    for (i = hash & mask;; i = (i + 1) & mask) {
+        e = &table->entries[i];
+        if (e->key == NULL ||
+                (e->hash == hash && e->len == len && memcmp(e->key, key, len) == 0))
+            return i;
+    }
+}
+
+void jsnn_intern_init(jsnn_intern *table, jsnn_intern_entry *entries,
+        unsigned int num_entries) {
+    /* Probing masks the hash, so round down to a power of two */
+    while (num_entries & (num_entries - 1))
+        num_entries &= num_entries - 1;
+    table->entries = entries;
+    table->num_entries = num_entries;
+    table->num_keys = 0;
+    memset(entries, 0, num_entries * sizeof(*entries));
+}
+
+int jsnn_intern_add(jsnn_intern *table, const char *key, int len) {
+    unsigned int hash = JSNN_HASH_INIT;
+    jsnn_intern_entry *e;
+    int i;
+
+    for (i = 0; i < len; i++)
+        hash = JSNN_HASH_STEP(hash, key[i]);
+    e = &table->entries[jsnn_intern_probe(table, key, len, hash)];
+    if (e->key != NULL)
+        return e->id;
+    /* Keep the table at most half full so probes stay short */
+    if ((unsigned int)(table->num_keys + 1) * 2 > table->num_entries)
+        return JSNN_ERROR_NOMEM;
+    e->key = key;
+    e->len = len;
+    e->hash = hash;
+    e->id = table->num_keys++;
+    return e->id;
+}
+
+int jsnn_intern_find(const jsnn_intern *table, const char *key, int len) {
+    unsigned int hash = JSNN_HASH_INIT;
+    jsnn_intern_entry *e;
+    int i;
+
+    for (i = 0; i < len; i++)
+        hash = JSNN_HASH_STEP(hash, key[i]);
+    e = &table->entries[jsnn_intern_probe(table, key, len, hash)];
+    return e->key != NULL ? e->id : -1;
+}
+
 /**
  * Filsl next token with JSON string.
  */
 static jsnnerr_t jsnn_parse_string(jsnn_parser *parser, const char *js,
-		jsnntok_t *tokens, size_t num_tokens, jsnnpair_t pairtype) {
+		jsnnuint_t len, jsnntok_t *tokens, size_t num_tokens,
+		jsnnpair_t pairtype) {
 	jsnntok_t *token;
+	jsnn_intern_entry *e;
+	unsigned int hash = JSNN_HASH_INIT;
+	int intern = parser->intern != NULL && pairtype == JSNN_NAME;
 
-	int start = parser->pos;
+	jsnnint_t start = parser->pos;
 
 	parser->pos++;
 
 	/* Skip starting quote */
-	for (; js[parser->pos] != '\0'; parser->pos++) {
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		char c = js[parser->pos];
 
 		/* Quote: end of string */
@@ -100,12 +165,26 @@ static jsnnerr_t jsnn_parse_string(jsnn_parser *parser, const char *js,
 			}
 			jsnn_fill_token(token, JSNN_STRING, pairtype, start+1, parser->pos);
 			token->parent = parser->toksuper;
+			if (intern) {
+				e = &parser->intern->entries[jsnn_intern_probe(parser->intern,
+						js + start + 1, parser->pos - start - 1, hash)];
+				if (e->key != NULL)
+					token->key = e->id;
+			}
 			return JSNN_SUCCESS;
 		}
 
+		/* Hash key bytes as they are scanned */
+		if (intern)
+			hash = JSNN_HASH_STEP(hash, c);
+
 		/* Backslash: Quoted symbol expected */
 		if (c == '\\') {
 			parser->pos++;
+			if (parser->pos == len)
+				break;
+			if (intern)
+				hash = JSNN_HASH_STEP(hash, js[parser->pos]);
 			switch (js[parser->pos]) {
 				/* Allowed escaped symbols */
 				case '\"': case '/' : case '\\' : case 'b' :
@@ -144,18 +223,18 @@ const char *jsnn_pair_type_strs[] = {
 static
 void print_token(const char *js, jsnntok_t *t) {
     printf("token:\n"
-        "  size: %d\n"
-        "  start: %d\n"
-        "  end: %d\n"
+        "  size: %ld\n"
+        "  start: %ld\n"
+        "  end: %ld\n"
         "  type: %s\n"
         "  pairtype: %s\n"
         "  val: %.*s\n\n",
-        t->size,
-        t->start,
-        t->end,
+        (long)t->size,
+        (long)t->start,
+        (long)t->end,
         jsnn_type_strs[t->type],
         jsnn_pair_type_strs[t->pair_type],
-        t->end - t->start,
+        (int)(t->end - t->start),
         js + t->start);
 }
 
@@ -179,159 +258,711 @@ int strnncmp(const char *s1, size_t n1, const char *s2, size_t n2) {
     return 0;
 }
 
+/**
+ * Token following the subtree rooted at tok. Every token's size counts its
+ * direct children, so a running tally of unvisited children suffices.
+ */
+static
+jsnntok_t *jsnn_skip(jsnntok_t *tok) {
+    jsnnint_t remaining = 1;
+    while (remaining > 0) {
+        remaining += tok->size - 1;
+        tok++;
+    }
+    return tok;
+}
+
+/**
+ * First child of a container, and the child after child. Containers
+ * reordered by jsnn_relayout keep their children contiguous from the
+ * index in key; in document order key is -1 and each child is followed
+ * by its subtree.
+ */
+static
+jsnntok_t *jsnn_first_child(jsnntok_t *tokens, jsnntok_t *tok) {
+    return tok->key >= 0 ? tokens + tok->key : tok + 1;
+}
+
+static
+jsnntok_t *jsnn_next_child(jsnntok_t *parent, jsnntok_t *child) {
+    return parent->key >= 0 ? child + 1 : jsnn_skip(child);
+}
+
 static
-jsnntok_t *jsnn_match_index(const char *js, jsnntok_t *tokens, jsnntok_t *arr_tok, int index) {
+jsnntok_t *jsnn_match_index(const char *js, jsnntok_t *tokens, jsnntok_t *arr_tok, jsnnint_t index) {
     jsnntok_t *tok;
-    int this, size, i;
 
-    if (arr_tok->type != JSNN_ARRAY) {
+    if (arr_tok->type != JSNN_ARRAY || index < 0 || index >= arr_tok->size) {
         return NULL;
     }
 
-    /* Advance through tokens til we find match */
-    this = arr_tok - tokens;
-    size = arr_tok->size;
-    i = 0;
-    for (tok = arr_tok + 1; i < size; tok++) {
-        if (tok->parent == this) {
-            if (i == index)
-                return tok;
-            i++;
-        }
-    }
-
-    return NULL;
+    tok = jsnn_first_child(tokens, arr_tok);
+    if (arr_tok->key >= 0)
+        return tok + index;
+    for (; index > 0; index--)
+        tok = jsnn_skip(tok);
+    return tok;
 }
 
 static
 jsnntok_t *jsnn_match_attr(const char *js, jsnntok_t *tokens, jsnntok_t *obj_tok, const char *name, int len) {
     jsnntok_t *tok;
-    int this, nattrs, hit;
+    jsnnint_t n;
 
     if (obj_tok->type != JSNN_OBJECT) {
         return NULL;
     }
 
-    /* Advance through tokens til we find match */
-    this = obj_tok - tokens;
-    nattrs = obj_tok->size / 2;
-    hit = 0;
-    for (tok = obj_tok; hit < nattrs; tok++) {
-        if (tok->pair_type == JSNN_NAME && tok->parent == this) {
-            if (strnncmp(js + tok->start, tok->end - tok->start, name, len) == 0)
-                return tok + 1;
-            hit++;
-        }
+    tok = jsnn_first_child(tokens, obj_tok);
+    for (n = obj_tok->size / 2; n > 0; n--) {
+        if (strnncmp(js + tok->start, tok->end - tok->start, name, len) == 0)
+            return tok + 1;
+        tok = jsnn_next_child(obj_tok, tok + 1);
     }
 
     return NULL;
 }
 
-jsnntok_t *jsnn_get(jsnntok_t *root, const char *path, const char *js, jsnntok_t *tokens) {
-    int pos;
-    int start, len, index;
-    char c, *chp;
+jsnntok_t *jsnn_get_key(jsnntok_t *obj, int key, jsnntok_t *tokens) {
     jsnntok_t *tok;
+    jsnnint_t n;
 
-    if (strlen(path) == 0) return NULL;
+    if (obj->type != JSNN_OBJECT || key < 0) {
+        return NULL;
+    }
 
-#ifdef JSNN_DEBUG
-    printf("path: %s\n", path);
-#endif
+    tok = jsnn_first_child(tokens, obj);
+    for (n = obj->size / 2; n > 0; n--) {
+        if (tok->key == key)
+            return tok + 1;
+        tok = jsnn_next_child(obj, tok + 1);
+    }
 
-    tok = root;
-    for (pos = 0, start = 0;;) {
-        c = path[pos];
+    return NULL;
+}
 
-        switch (c) {
-        case '.':
-#ifdef JSNN_DEBUG
-            printf("  found . at %d\n", pos);
-#endif
-            len = pos - start;
-            if ((tok = jsnn_match_attr(js, tokens, tok, path + start, len)) == NULL)
-                return NULL;
-            start = ++pos;
-            break;
-        case '[':
-#ifdef JSNN_DEBUG
-            printf("  found [ at %d\n", pos);
-#endif
-            if (start > 0) {
-                /* Indicates end of attr specification */
-                len = pos - start;
-                if ((tok = jsnn_match_attr(js, tokens, tok, path + start, len)) == NULL)
-                    return NULL;
-            }
+/**
+ * Compile the name or '*' that follows a '.', '..' or starts the path.
+ */
+static
+const char *jsnn_compile_name(jsnn_step *step, const char *s, int descend) {
+    const char *name = s;
+
+    if (*s == '*') {
+        step->kind = descend ? JSNN_STEP_DESCEND_ANY : JSNN_STEP_ANY;
+        return s + 1;
+    }
+    for (; *s != '\0' && *s != '.' && *s != '['; s++) {
+        switch (*s) {
+        case '\t': case '\r': case '\n': case ' ':
+            return NULL;
+        }
+    }
+    if (s == name)
+        return NULL;
+    step->kind = descend ? JSNN_STEP_DESCEND : JSNN_STEP_KEY;
+    step->name = name;
+    step->len = s - name;
+    return s;
+}
 
-            c = path[++pos];
+/**
+ * Filter expressions, "[?(...)]", are interpreted straight from the path
+ * text against the candidate token, so evaluation needs no allocation.
+ *
+ *     expr    := and ('||' and)*
+ *     and     := unary ('&&' unary)*
+ *     unary   := '!' unary | '(' expr ')' | operand (cmp operand)?
+ *     operand := '@' ('.' name | '[' index ']' | "['" name "']")*
+ *              | string | number | true | false | null
+ *
+ * A lone '@' operand tests for existence. Strings compare by their raw
+ * bytes, numbers numerically; values of different types are never equal.
+ */
+typedef enum {
+    JSNN_FV_NONE = 0,
+    JSNN_FV_STRING = 1,
+    JSNN_FV_NUMBER = 2,
+    JSNN_FV_LITERAL = 3,
+    JSNN_FV_CONTAINER = 4
+} jsnn_fvtype;
 
-            if (c >= '0' && c <= '9') {
-                /* Bracket is an index spec. */
-                index = strtol(path + pos, &chp, 10);
-                if ((tok = jsnn_match_index(js, tokens, tok, index)) == NULL)
-                    return NULL;
-                pos += chp - (path + pos);
-            } else if (c == '\'') {
-                /* Bracket is an attribute spec */
-                start = ++pos;
-                for (pos;; pos++) {
-                    c = path[pos];
-                    if (c == '\'' && path[pos - 1] != '\\') {
-                        len = pos - start;
-                        if ((tok = jsnn_match_attr(js, tokens, tok, path + start, len)) == NULL)
-                            return NULL;
-                        break;
-                    }
+typedef struct {
+    jsnn_fvtype type;
+    const char *p;
+    jsnnint_t len;
+    double num;
+} jsnn_fval;
+
+typedef struct {
+    const char *s;
+    const char *js;
+    jsnntok_t *tokens;
+    jsnntok_t *cur;
+    int err;
+} jsnn_filter;
+
+static
+int jsnn_filter_or(jsnn_filter *f);
+
+static
+void jsnn_filter_ws(jsnn_filter *f) {
+    while (*f->s == ' ' || *f->s == '\t' || *f->s == '\r' || *f->s == '\n')
+        f->s++;
+}
+
+static
+int jsnn_filter_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '$';
+}
+
+/**
+ * Scan a quoted string starting at s; returns the closing quote or NULL.
+ */
+static
+const char *jsnn_filter_quoted(const char *s) {
+    char q = *s++;
+    for (; *s != q; s++) {
+        if (*s == '\0')
+            return NULL;
+        if (*s == '\\' && s[1] != '\0')
+            s++;
+    }
+    return s;
+}
+
+static
+void jsnn_filter_token(jsnn_filter *f, jsnntok_t *tok, jsnn_fval *v) {
+    char c;
+
+    if (tok == NULL) {
+        v->type = JSNN_FV_NONE;
+        return;
+    }
+    v->p = f->js + tok->start;
+    v->len = tok->end - tok->start;
+    c = *v->p;
+    if (tok->type == JSNN_STRING) {
+        v->type = JSNN_FV_STRING;
+    } else if (tok->type != JSNN_PRIMITIVE) {
+        v->type = JSNN_FV_CONTAINER;
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        v->type = JSNN_FV_NUMBER;
+        v->num = strtod(v->p, NULL);
+    } else {
+        v->type = JSNN_FV_LITERAL;
+    }
+}
+
+static
+void jsnn_filter_operand(jsnn_filter *f, jsnn_fval *v) {
+    const char *start, *end;
+    jsnntok_t *tok;
+    char *num_end;
+
+    jsnn_filter_ws(f);
+    start = f->s;
+
+    if (*f->s == '@') {
+        tok = f->cur;
+        f->s++;
+        for (;;) {
+            if (*f->s == '.') {
+                start = ++f->s;
+                while (jsnn_filter_name_char(*f->s))
+                    f->s++;
+                if (f->s == start) {
+                    f->err = 1;
+                    return;
                 }
+                if (tok != NULL)
+                    tok = jsnn_match_attr(f->js, f->tokens, tok, start, f->s - start);
+            } else if (*f->s == '[' && f->s[1] >= '0' && f->s[1] <= '9') {
+                jsnnint_t index = strtol(f->s + 1, &num_end, 10);
+                if (*num_end != ']') {
+                    f->err = 1;
+                    return;
+                }
+                f->s = num_end + 1;
+                if (tok != NULL)
+                    tok = jsnn_match_index(f->js, f->tokens, tok, index);
+            } else if (*f->s == '[' && f->s[1] == '\'') {
+                if ((end = jsnn_filter_quoted(f->s + 1)) == NULL || end[1] != ']') {
+                    f->err = 1;
+                    return;
+                }
+                if (tok != NULL)
+                    tok = jsnn_match_attr(f->js, f->tokens, tok, f->s + 2,
+                            end - f->s - 2);
+                f->s = end + 2;
             } else {
-                printf("Bad char in bracket expression.\n");
-                return NULL;
+                break;
             }
+        }
+        jsnn_filter_token(f, tok, v);
+    } else if (*f->s == '\'' || *f->s == '"') {
+        if ((end = jsnn_filter_quoted(f->s)) == NULL) {
+            f->err = 1;
+            return;
+        }
+        v->type = JSNN_FV_STRING;
+        v->p = f->s + 1;
+        v->len = end - v->p;
+        f->s = end + 1;
+    } else if (*f->s == '-' || (*f->s >= '0' && *f->s <= '9')) {
+        v->type = JSNN_FV_NUMBER;
+        v->num = strtod(f->s, &num_end);
+        f->s = num_end;
+    } else if (strncmp(f->s, "true", 4) == 0 || strncmp(f->s, "null", 4) == 0
+            || strncmp(f->s, "false", 5) == 0) {
+        v->type = JSNN_FV_LITERAL;
+        v->p = f->s;
+        v->len = *f->s == 'f' ? 5 : 4;
+        f->s += v->len;
+    } else {
+        f->err = 1;
+    }
+}
+
+/**
+ * Compare two values; returns -1, 0 or 1, or 2 if they are unordered
+ * (different types, or neither a string nor a number).
+ */
+static
+int jsnn_filter_order(jsnn_fval *a, jsnn_fval *b) {
+    int r;
+
+    if (a->type != b->type || a->type == JSNN_FV_NONE
+            || a->type == JSNN_FV_CONTAINER)
+        return 2;
+    if (a->type == JSNN_FV_NUMBER)
+        return a->num < b->num ? -1 : a->num > b->num;
+    /* strnncmp returns a byte difference, which could read as 2 */
+    r = strnncmp(a->p, a->len, b->p, b->len);
+    return r < 0 ? -1 : r > 0;
+}
+
+static
+int jsnn_filter_unary(jsnn_filter *f) {
+    jsnn_fval a, b;
+    int r, order;
+    char op, eq;
+
+    jsnn_filter_ws(f);
+    if (*f->s == '!' && f->s[1] != '=') {
+        f->s++;
+        return !jsnn_filter_unary(f);
+    }
+    if (*f->s == '(') {
+        f->s++;
+        r = jsnn_filter_or(f);
+        jsnn_filter_ws(f);
+        if (*f->s != ')')
+            f->err = 1;
+        else
+            f->s++;
+        return r;
+    }
+
+    jsnn_filter_operand(f, &a);
+    if (f->err)
+        return 0;
+    jsnn_filter_ws(f);
+    op = *f->s;
+    if (op != '=' && op != '!' && op != '<' && op != '>')
+        return a.type != JSNN_FV_NONE;
+
+    eq = f->s[1] == '=';
+    if ((op == '=' || op == '!') && !eq) {
+        f->err = 1;
+        return 0;
+    }
+    f->s += eq ? 2 : 1;
+    jsnn_filter_operand(f, &b);
+
+    order = jsnn_filter_order(&a, &b);
+    switch (op) {
+    case '=':
+        return order == 0;
+    case '!':
+        return order != 0;
+    }
+    if (order == 2 || a.type == JSNN_FV_LITERAL)
+        return 0;
+    if (op == '<')
+        return eq ? order <= 0 : order < 0;
+    return eq ? order >= 0 : order > 0;
+}
+
+static
+int jsnn_filter_and(jsnn_filter *f) {
+    int r = jsnn_filter_unary(f);
+    for (;;) {
+        jsnn_filter_ws(f);
+        if (f->s[0] != '&' || f->s[1] != '&')
+            return r;
+        f->s += 2;
+        /* Always evaluate, to move past the operand */
+        r = jsnn_filter_unary(f) && r;
+    }
+}
+
+static
+int jsnn_filter_or(jsnn_filter *f) {
+    int r = jsnn_filter_and(f);
+    for (;;) {
+        jsnn_filter_ws(f);
+        if (f->s[0] != '|' || f->s[1] != '|')
+            return r;
+        f->s += 2;
+        r = jsnn_filter_and(f) || r;
+    }
+}
+
+/**
+ * Evaluate the filter of step against tok. Returns 1 or 0 for a match,
+ * or -1 on a syntax error.
+ */
+static
+int jsnn_filter_eval(const jsnn_step *step, const char *js,
+        jsnntok_t *tokens, jsnntok_t *tok) {
+    jsnn_filter f;
+    int r;
+
+    f.s = step->name;
+    f.js = js;
+    f.tokens = tokens;
+    f.cur = tok;
+    f.err = 0;
+    r = jsnn_filter_or(&f);
+    jsnn_filter_ws(&f);
+    if (f.err || f.s != step->name + step->len)
+        return -1;
+    return r;
+}
+
+/**
+ * Compile the inside of a bracket expression; s points past the '['.
+ */
+static
+const char *jsnn_compile_bracket(jsnn_step *step, const char *s) {
+    const char *name;
+    char *end;
+    int depth;
 
-            if (path[pos] != ']') {
-                printf("Bracket not closed properly.\n");
+    if (*s == '*') {
+        step->kind = JSNN_STEP_ANY;
+        s++;
+    } else if (*s >= '0' && *s <= '9') {
+        step->kind = JSNN_STEP_INDEX;
+        step->index = strtol(s, &end, 10);
+        s = end;
+    } else if (*s == '?' && s[1] == '(') {
+        /* Filter: find the matching paren, skipping quoted strings */
+        name = s += 2;
+        for (depth = 1;; s++) {
+            if (*s == '\0')
                 return NULL;
-            }
-            break;
-        case '\0':
-            if (path[pos - 1] != ']') {
-                /* Grab the last attr. */
-                len = pos - start;
-                if ((tok = jsnn_match_attr(js, tokens, tok, path + start, len)) == NULL)
+            if (*s == '\'' || *s == '"') {
+                if ((s = jsnn_filter_quoted(s)) == NULL)
                     return NULL;
+            } else if (*s == '(') {
+                depth++;
+            } else if (*s == ')' && --depth == 0) {
+                break;
             }
-            return tok;
-        case '\t':
-        case '\r':
-        case '\n':
-        case ' ':
-            printf("no spaces outside of quotes\n");
+        }
+        step->kind = JSNN_STEP_FILTER;
+        step->name = name;
+        step->len = s - name;
+        /* Check the syntax up front; with no current token every @ is missing */
+        if (jsnn_filter_eval(step, NULL, NULL, NULL) < 0)
             return NULL;
-        default:
-            pos++;
+        s++;
+    } else if (*s == '\'') {
+        /* Quoted attribute; the name may contain escaped quotes */
+        name = ++s;
+        for (; *s != '\'' || s[-1] == '\\'; s++) {
+            if (*s == '\0')
+                return NULL;
         }
+        step->kind = JSNN_STEP_KEY;
+        step->name = name;
+        step->len = s - name;
+        s++;
+    } else {
+        return NULL;
     }
+    return *s == ']' ? s + 1 : NULL;
+}
 
-    printf("The great escape!\n");
-    return NULL;
+jsnnerr_t jsnn_compile(jsnn_path *compiled, const char *path) {
+    const char *s = path;
+    jsnn_step *step;
+    int descend;
+
+    compiled->num_steps = 0;
+    if (*s == '\0')
+        return JSNN_ERROR_INVAL;
+
+    while (*s != '\0') {
+        if (compiled->num_steps == JSNN_MAX_STEPS)
+            return JSNN_ERROR_NOMEM;
+        step = &compiled->steps[compiled->num_steps];
+        step->name = NULL;
+        step->len = 0;
+        step->index = 0;
+
+        if (*s == '[') {
+            s = jsnn_compile_bracket(step, s + 1);
+        } else if (*s == '.' || s == path) {
+            descend = 0;
+            if (*s == '.') {
+                s++;
+                if (*s == '.') {
+                    descend = 1;
+                    s++;
+                }
+            }
+            s = jsnn_compile_name(step, s, descend);
+        } else {
+            s = NULL;
+        }
+        if (s == NULL)
+            return JSNN_ERROR_INVAL;
+        compiled->num_steps++;
+    }
+    return JSNN_SUCCESS;
 }
 
+typedef struct {
+    const char *js;
+    jsnntok_t *tokens;
+    const jsnn_path *path;
+    jsnntok_t **out;
+    jsnnint_t max_out;
+    jsnnint_t count;
+    jsnn_select_cb cb;
+    void *data;
+    int stop;
+} jsnn_select_ctx;
 
+static
+void jsnn_select_from(jsnn_select_ctx *ctx, jsnntok_t *tok, int i);
 
 /**
- * Parse JSON string and fill tokens.
+ * Apply a recursive-descent step to every object member or array element
+ * below tok, in document order.
  */
-jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens, 
-		unsigned int num_tokens) {
+static
+void jsnn_select_descend(jsnn_select_ctx *ctx, jsnntok_t *tok, int i) {
+    const jsnn_step *step = &ctx->path->steps[i];
+    jsnntok_t *child;
+    jsnnint_t n;
+
+    if (tok->type == JSNN_OBJECT) {
+        child = jsnn_first_child(ctx->tokens, tok);
+        for (n = tok->size / 2; n > 0 && !ctx->stop; n--) {
+            if (step->kind == JSNN_STEP_DESCEND_ANY
+                    || strnncmp(ctx->js + child->start, child->end - child->start,
+                        step->name, step->len) == 0)
+                jsnn_select_from(ctx, child + 1, i + 1);
+            jsnn_select_descend(ctx, child + 1, i);
+            child = jsnn_next_child(tok, child + 1);
+        }
+    } else if (tok->type == JSNN_ARRAY) {
+        child = jsnn_first_child(ctx->tokens, tok);
+        for (n = tok->size; n > 0 && !ctx->stop; n--) {
+            if (step->kind == JSNN_STEP_DESCEND_ANY)
+                jsnn_select_from(ctx, child, i + 1);
+            jsnn_select_descend(ctx, child, i);
+            child = jsnn_next_child(tok, child);
+        }
+    }
+}
+
+/**
+ * Match steps i.. of the path against tok, emitting every token reached
+ * once all steps are consumed.
+ */
+static
+void jsnn_select_from(jsnn_select_ctx *ctx, jsnntok_t *tok, int i) {
+    const jsnn_step *step;
+    jsnntok_t *child;
+    jsnnint_t n;
+
+    if (ctx->stop)
+        return;
+
+    if (i == ctx->path->num_steps) {
+        if (ctx->count < ctx->max_out)
+            ctx->out[ctx->count] = tok;
+        ctx->count++;
+        if (ctx->cb != NULL && ctx->cb(tok, ctx->data))
+            ctx->stop = 1;
+        return;
+    }
+
+    step = &ctx->path->steps[i];
+    switch (step->kind) {
+    case JSNN_STEP_KEY:
+        child = jsnn_match_attr(ctx->js, ctx->tokens, tok, step->name, step->len);
+        if (child != NULL)
+            jsnn_select_from(ctx, child, i + 1);
+        break;
+    case JSNN_STEP_INDEX:
+        child = jsnn_match_index(ctx->js, ctx->tokens, tok, step->index);
+        if (child != NULL)
+            jsnn_select_from(ctx, child, i + 1);
+        break;
+    case JSNN_STEP_ANY:
+    case JSNN_STEP_FILTER:
+        if (tok->type == JSNN_OBJECT) {
+            child = jsnn_first_child(ctx->tokens, tok);
+            for (n = tok->size / 2; n > 0 && !ctx->stop; n--) {
+                if (step->kind == JSNN_STEP_ANY || jsnn_filter_eval(step,
+                        ctx->js, ctx->tokens, child + 1) > 0)
+                    jsnn_select_from(ctx, child + 1, i + 1);
+                child = jsnn_next_child(tok, child + 1);
+            }
+        } else if (tok->type == JSNN_ARRAY) {
+            child = jsnn_first_child(ctx->tokens, tok);
+            for (n = tok->size; n > 0 && !ctx->stop; n--) {
+                if (step->kind == JSNN_STEP_ANY || jsnn_filter_eval(step,
+                        ctx->js, ctx->tokens, child) > 0)
+                    jsnn_select_from(ctx, child, i + 1);
+                child = jsnn_next_child(tok, child);
+            }
+        }
+        break;
+    case JSNN_STEP_DESCEND:
+    case JSNN_STEP_DESCEND_ANY:
+        jsnn_select_descend(ctx, tok, i);
+        break;
+    }
+}
+
+static
+jsnnint_t jsnn_select_run(jsnntok_t *root, const jsnn_path *path,
+        const char *js, jsnntok_t *tokens, jsnntok_t **out, jsnnint_t max_out,
+        jsnn_select_cb cb, void *data) {
+    jsnn_select_ctx ctx;
+
+    ctx.js = js;
+    ctx.tokens = tokens;
+    ctx.path = path;
+    ctx.out = out;
+    ctx.max_out = out == NULL ? 0 : max_out;
+    ctx.count = 0;
+    ctx.cb = cb;
+    ctx.data = data;
+    ctx.stop = 0;
+    jsnn_select_from(&ctx, root, 0);
+    return ctx.count;
+}
+
+jsnnint_t jsnn_select(jsnntok_t *root, const jsnn_path *path, const char *js,
+        jsnntok_t *tokens, jsnntok_t **out, jsnnint_t max_out) {
+    return jsnn_select_run(root, path, js, tokens, out, max_out, NULL, NULL);
+}
+
+jsnnint_t jsnn_select_each(jsnntok_t *root, const jsnn_path *path,
+        const char *js, jsnntok_t *tokens, jsnn_select_cb cb, void *data) {
+    return jsnn_select_run(root, path, js, tokens, NULL, 0, cb, data);
+}
+
+jsnnint_t jsnn_query(jsnntok_t *root, const char *path, const char *js,
+        jsnntok_t *tokens, jsnntok_t **out, jsnnint_t max_out) {
+    jsnn_path compiled;
+    jsnnerr_t r;
+
+    if ((r = jsnn_compile(&compiled, path)) < 0)
+        return r;
+    return jsnn_select(root, &compiled, js, tokens, out, max_out);
+}
+
+static
+int jsnn_select_stop(jsnntok_t *tok, void *data) {
+    *(jsnntok_t **)data = tok;
+    return 1;
+}
+
+jsnntok_t *jsnn_select_first(jsnntok_t *root, const jsnn_path *path,
+        const char *js, jsnntok_t *tokens) {
+    jsnntok_t *tok = NULL;
+
+    jsnn_select_each(root, path, js, tokens, jsnn_select_stop, &tok);
+    return tok;
+}
+
+jsnntok_t *jsnn_get(jsnntok_t *root, const char *path, const char *js, jsnntok_t *tokens) {
+    jsnn_path compiled;
+
+    if (jsnn_compile(&compiled, path) < 0)
+        return NULL;
+    return jsnn_select_first(root, &compiled, js, tokens);
+}
+
+
+
+/**
+ * The output doubles as the breadth-first queue. Until a container's
+ * children are placed, its key holds its index in the input.
+ */
+jsnnerr_t jsnn_relayout(jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnntok_t *out) {
+    jsnntok_t *src, *child;
+    jsnnint_t i, n = 0, c;
+
+    if (num_tokens > INT_MAX)
+        return JSNN_ERROR_NOMEM;
+
+    for (i = 0; i < num_tokens; i++) {
+        if (tokens[i].parent != -1)
+            continue;
+        out[n] = tokens[i];
+        if (out[n].type == JSNN_OBJECT || out[n].type == JSNN_ARRAY)
+            out[n].key = (int)i;
+        n++;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (out[i].type != JSNN_OBJECT && out[i].type != JSNN_ARRAY)
+            continue;
+        src = &tokens[out[i].key];
+        out[i].key = (int)n;
+        child = jsnn_first_child(tokens, src);
+        for (c = src->size; c > 0; c--) {
+            out[n] = *child;
+            out[n].parent = i;
+            if (child->type == JSNN_OBJECT || child->type == JSNN_ARRAY)
+                out[n].key = (int)(child - tokens);
+            n++;
+            child = jsnn_next_child(src, child);
+        }
+    }
+    return JSNN_SUCCESS;
+}
+
+/**
+ * Tokenize from the parser's position. With single set, stop right after
+ * the first top-level object or array closes.
+ */
+static jsnnerr_t jsnn_parse_loop(jsnn_parser *parser, const char *js,
+		jsnnuint_t len, jsnntok_t *tokens, jsnnuint_t num_tokens, int single) {
 	jsnnerr_t r;
-	int i;
 	jsnntok_t *token;
-    jsnnpair_t pairtype;
+    jsnnpair_t pairtype = JSNN_VALUE;
+
+    /* When resuming inside an object, an even child count means a key is due */
+    if (parser->toksuper != -1 && tokens[parser->toksuper].type == JSNN_OBJECT
+            && tokens[parser->toksuper].size % 2 == 0)
+        pairtype = JSNN_NAME;
 
     //printf("json: %s\n", js);
 
-	for (; js[parser->pos] != '\0'; parser->pos++) {
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		char c;
 		jsnntype_t type;
 
@@ -349,8 +980,7 @@ jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens,
                 token->pair_type = JSNN_VALUE;
 				token->start = parser->pos;
 				parser->toksuper = parser->toknext - 1;
-                if (c == '{')
-                    pairtype = JSNN_NAME;
+                pairtype = (c == '{' ? JSNN_NAME : JSNN_VALUE);
 				break;
 			case '}': case ']':
 				type = (c == '}' ? JSNN_OBJECT : JSNN_ARRAY);
@@ -372,13 +1002,19 @@ jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens,
 					}
 					token = &tokens[token->parent];
 				}
+                pairtype = JSNN_VALUE;
+                if (single && parser->toksuper == -1) {
+                    parser->pos++;
+                    return JSNN_SUCCESS;
+                }
                 break;
             case ',':
-                if (tokens[parser->toksuper].type == JSNN_OBJECT)
+                if (parser->toksuper != -1
+                        && tokens[parser->toksuper].type == JSNN_OBJECT)
                     pairtype = JSNN_NAME;
 				break;
 			case '\"':
-				r = jsnn_parse_string(parser, js, tokens, num_tokens, pairtype);
+				r = jsnn_parse_string(parser, js, len, tokens, num_tokens, pairtype);
 				if (r < 0) return r;
 				if (parser->toksuper != -1)
 					tokens[parser->toksuper].size++;
@@ -397,7 +1033,7 @@ jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens,
 			/* In non-strict mode every unquoted value is a primitive */
 			default:
 #endif
-				r = jsnn_parse_primitive(parser, js, tokens, num_tokens);
+				r = jsnn_parse_primitive(parser, js, len, tokens, num_tokens);
 				if (r < 0) return r;
 				if (parser->toksuper != -1)
 					tokens[parser->toksuper].size++;
@@ -412,6 +1048,25 @@ jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens,
 		}
 	}
 
+	return JSNN_SUCCESS;
+}
+
+/**
+ * Parse JSON string and fill tokens.
+ */
+jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens, 
+		jsnnuint_t num_tokens) {
+	return jsnn_parse_len(parser, js, (jsnnuint_t)-1, tokens, num_tokens);
+}
+
+jsnnerr_t jsnn_parse_len(jsnn_parser *parser, const char *js, jsnnuint_t len,
+		jsnntok_t *tokens, jsnnuint_t num_tokens) {
+	jsnnerr_t r;
+	jsnnint_t i;
+
+	r = jsnn_parse_loop(parser, js, len, tokens, num_tokens, 0);
+	if (r < 0) return r;
+
 	for (i = parser->toknext - 1; i >= 0; i--) {
 		/* Unmatched opened object or array */
 		if (tokens[i].start != -1 && tokens[i].end == -1) {
@@ -423,21 +1078,232 @@ jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, jsnntok_t *tokens,
 }
 
 /**
- * Creates a new parser based over a given  buffer with an array of tokens 
- * available.
+ * Index of the deepest object or array whose brackets strictly enclose
+ * [start, end), or -1. Children are visited in order, so the scan only
+ * descends into one subtree per level.
  */
-void jsnn_init(jsnn_parser *parser) {
+static
+jsnnint_t jsnn_enclosing(jsnntok_t *tokens, jsnnint_t num_tokens,
+		jsnnint_t start, jsnnint_t end) {
+	jsnntok_t *tok;
+	jsnnint_t i = 0, limit = num_tokens, found = -1;
+
+	while (i < limit) {
+		tok = &tokens[i];
+		if ((tok->type == JSNN_OBJECT || tok->type == JSNN_ARRAY)
+				&& tok->start < start && end < tok->end) {
+			found = i;
+			limit = jsnn_skip(tok) - tokens;
+			i++;
+			continue;
+		}
+		if (tok->start >= end)
+			break;
+		i = jsnn_skip(tok) - tokens;
+	}
+	return found;
+}
+
+static
+void jsnn_reverse(jsnntok_t *lo, jsnntok_t *hi) {
+	jsnntok_t tmp;
+	for (hi--; lo < hi; lo++, hi--) {
+		tmp = *lo;
+		*lo = *hi;
+		*hi = tmp;
+	}
+}
+
+jsnnerr_t jsnn_reparse(jsnn_parser *parser, const char *js,
+		jsnntok_t *tokens, jsnnuint_t num_tokens,
+		jsnnint_t start, jsnnint_t old_end, jsnnint_t new_end) {
+	jsnn_parser sub;
+	jsnnerr_t r;
+	jsnnint_t c, e, n, k, i, p, parent, delta, shift;
+
+	n = parser->toknext;
+	delta = new_end - old_end;
+	c = jsnn_enclosing(tokens, n, start, old_end);
+	if (c == -1)
+		goto full;
+	e = jsnn_skip(&tokens[c]) - tokens;
+	parent = tokens[c].parent;
+
+	/* Tokenize the new container text into the free tokens past n */
+	sub.pos = tokens[c].start;
+	sub.toknext = n;
+	sub.toksuper = -1;
+	sub.intern = parser->intern;
+	r = jsnn_parse_loop(&sub, js, (jsnnuint_t)-1, tokens, num_tokens, 1);
+	if (r == JSNN_ERROR_NOMEM)
+		return r;
+	/* The edit moved the closing bracket: the rest must be reparsed too */
+	if (r < 0 || tokens[n].end != tokens[c].end + delta)
+		goto full;
+	k = sub.toknext - n;
+
+	/* Drop the old subtree, then rotate the new one in front of the tail */
+	memmove(&tokens[c], &tokens[e], (n - e + k) * sizeof(jsnntok_t));
+	jsnn_reverse(&tokens[c], &tokens[c + n - e]);
+	jsnn_reverse(&tokens[c + n - e], &tokens[c + n - e + k]);
+	jsnn_reverse(&tokens[c], &tokens[c + n - e + k]);
+
+	shift = k - (e - c);
+	for (i = c; i < c + k; i++) {
+		if (tokens[i].parent != -1)
+			tokens[i].parent += c - n;
+	}
+	tokens[c].parent = parent;
+	for (p = parent; p != -1; p = tokens[p].parent)
+		tokens[p].end += delta;
+	for (i = c + k; i < n + shift; i++) {
+		tokens[i].start += delta;
+		tokens[i].end += delta;
+		if (tokens[i].parent >= e)
+			tokens[i].parent += shift;
+	}
+	parser->toknext = n + shift;
+	parser->pos += delta;
+	return JSNN_SUCCESS;
+
+full:
 	parser->pos = 0;
 	parser->toknext = 0;
 	parser->toksuper = -1;
+	return jsnn_parse(parser, js, tokens, num_tokens);
 }
 
+void jsnn_sax_init(jsnn_sax *parser) {
+	parser->pos = 0;
+	parser->depth = 0;
+	parser->stopped = 0;
+	parser->final = 0;
+	parser->pairtype = JSNN_VALUE;
+}
 
-int jsnn_cmp(jsnntok_t *token, const char *json, const char *s) {
-    //printf("comparing %.*s with %.*s\n", n1, s1, n2, s2);
-    size_t pos, len;
-    int diff;
-    char c;
+/**
+ * Report a string or primitive, which is a key if one is due.
+ */
+static
+int jsnn_sax_scalar(jsnn_sax *parser, jsnnevent_t event,
+		jsnnint_t start, jsnnint_t end, jsnn_event_cb cb, void *data) {
+	if (parser->pairtype == JSNN_NAME)
+		event = JSNN_EVENT_KEY;
+	parser->pairtype = JSNN_VALUE;
+	return cb(event, start, end, parser->depth, data);
+}
+
+jsnnerr_t jsnn_sax_parse(jsnn_sax *parser, const char *js, jsnnuint_t len,
+		jsnn_event_cb cb, void *data) {
+	jsnnuint_t pos, start;
+	jsnntype_t type;
+	int stop;
+	char c;
+
+	parser->stopped = 0;
+	for (pos = parser->pos; pos < len; parser->pos = ++pos) {
+		c = js[pos];
+		switch (c) {
+			case '{': case '[':
+				if (parser->depth == JSNN_MAX_DEPTH)
+					return JSNN_ERROR_NOMEM;
+				type = (c == '{' ? JSNN_OBJECT : JSNN_ARRAY);
+				parser->pairtype = JSNN_VALUE;
+				stop = cb(c == '{' ? JSNN_EVENT_BEGIN_OBJECT
+						: JSNN_EVENT_BEGIN_ARRAY, pos, pos + 1, parser->depth, data);
+				parser->open[parser->depth++] = type;
+				parser->pairtype = (c == '{' ? JSNN_NAME : JSNN_VALUE);
+				break;
+			case '}': case ']':
+				type = (c == '}' ? JSNN_OBJECT : JSNN_ARRAY);
+				if (parser->depth == 0 || parser->open[parser->depth - 1] != type)
+					return JSNN_ERROR_INVAL;
+				parser->depth--;
+				parser->pairtype = JSNN_VALUE;
+				stop = cb(c == '}' ? JSNN_EVENT_END_OBJECT : JSNN_EVENT_END_ARRAY,
+						pos, pos + 1, parser->depth, data);
+				break;
+			case ',':
+				if (parser->depth > 0 && parser->open[parser->depth - 1] == JSNN_OBJECT)
+					parser->pairtype = JSNN_NAME;
+				continue;
+			case ':':
+				parser->pairtype = JSNN_VALUE;
+				continue;
+			case '\t' : case '\r' : case '\n' : case ' ':
+				continue;
+			case '\"':
+				for (start = ++pos; pos < len && js[pos] != '\"'; pos++) {
+					if (js[pos] == '\\' && ++pos == len)
+						break;
+				}
+				if (pos >= len)
+					return JSNN_ERROR_PART;
+				stop = jsnn_sax_scalar(parser, JSNN_EVENT_STRING, start, pos,
+						cb, data);
+				break;
+			default:
+#ifdef JSNN_STRICT
+				if (!(c == '-' || (c >= '0' && c <= '9')
+						|| c == 't' || c == 'f' || c == 'n'))
+					return JSNN_ERROR_INVAL;
+#endif
+				for (start = pos; pos < len; pos++) {
+					c = js[pos];
+					if (c == '\t' || c == '\r' || c == '\n' || c == ' '
+							|| c == ',' || c == ']' || c == '}'
+#ifndef JSNN_STRICT
+							|| c == ':'
+#endif
+							)
+						break;
+					if (c < 32 || c >= 127)
+						return JSNN_ERROR_INVAL;
+				}
+				/* More of the primitive may follow in the next chunk */
+				if (pos == len && !parser->final)
+					return JSNN_ERROR_PART;
+				stop = jsnn_sax_scalar(parser, JSNN_EVENT_PRIMITIVE, start, pos,
+						cb, data);
+				pos--;
+				break;
+		}
+		if (stop) {
+			parser->pos = pos + 1;
+			parser->stopped = 1;
+			return JSNN_SUCCESS;
+		}
+	}
+	return parser->depth > 0 ? JSNN_ERROR_PART : JSNN_SUCCESS;
+}
+
+jsnnerr_t jsnn_sax_finish(jsnn_sax *parser, const char *js, jsnnuint_t len,
+		jsnn_event_cb cb, void *data) {
+	jsnnerr_t r;
+
+	parser->final = 1;
+	r = jsnn_sax_parse(parser, js, len, cb, data);
+	parser->final = 0;
+	return r;
+}
+
+/**
+ * Creates a new parser based over a given  buffer with an array of tokens 
+ * available.
+ */
+void jsnn_init(jsnn_parser *parser) {
+	parser->pos = 0;
+	parser->toknext = 0;
+	parser->toksuper = -1;
+	parser->intern = NULL;
+}
+
+
+int jsnn_cmp(jsnntok_t *token, const char *json, const char *s) {
+    //printf("comparing %.*s with %.*s\n", n1, s1, n2, s2);
+    size_t pos, len;
+    int diff;
+    char c;
 
     len = token->end - token->start;
     for (pos = 0;; pos++) {
@@ -453,3 +1319,1303 @@ int jsnn_cmp(jsnntok_t *token, const char *json, const char *s) {
     }
     return 0;
 }
+
+
+/**
+ * First/one-past-last byte of a token's full text. String tokens exclude
+ * their quotes, so widen them by one on each side.
+ */
+static
+jsnnint_t jsnn_span_start(jsnntok_t *t) {
+    return t->type == JSNN_STRING ? t->start - 1 : t->start;
+}
+
+static
+jsnnint_t jsnn_span_end(jsnntok_t *t) {
+    return t->type == JSNN_STRING ? t->end + 1 : t->end;
+}
+
+/**
+ * Index of the first token after the subtree rooted at i. Descendants of a
+ * container immediately follow it and start before it ends.
+ */
+static
+jsnnint_t jsnn_subtree_end(jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnnint_t i) {
+    jsnnint_t j = i + 1;
+    if (tokens[i].type == JSNN_OBJECT || tokens[i].type == JSNN_ARRAY) {
+        while (j < num_tokens && tokens[j].start < tokens[i].end)
+            j++;
+    }
+    return j;
+}
+
+/**
+ * Members of a container are its elements (arrays) or its keys (objects,
+ * the value always directly follows its key). These walk members
+ * structurally rather than trusting pair_type, which is not set for
+ * unquoted keys.
+ */
+static
+jsnnint_t jsnn_member_last(jsnntok_t *tokens, jsnnint_t m) {
+    return tokens[tokens[m].parent].type == JSNN_OBJECT ? m + 1 : m;
+}
+
+static
+jsnnint_t jsnn_next_member(jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnnint_t m) {
+    jsnnint_t j = jsnn_subtree_end(tokens, num_tokens, jsnn_member_last(tokens, m));
+    if (j < num_tokens && tokens[j].parent == tokens[m].parent)
+        return j;
+    return -1;
+}
+
+static
+jsnnint_t jsnn_first_member(jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnnint_t c) {
+    if (tokens[c].size == 0 || c + 1 >= num_tokens)
+        return -1;
+    return c + 1;
+}
+
+typedef struct {
+    char *out;
+    jsnnuint_t cap;
+    jsnnuint_t len;
+} jsnn_outbuf;
+
+static
+void jsnn_put(jsnn_outbuf *b, const char *s, jsnnuint_t n) {
+    if (b->len < b->cap) {
+        jsnnuint_t room = b->cap - b->len;
+        memcpy(b->out + b->len, s, n < room ? n : room);
+    }
+    b->len += n;
+}
+
+/**
+ * An edit resolved to a byte range. Deletes and inserts also record the
+ * member they apply to, found once, so commas can be placed from this
+ * table alone: within a container, items are ordered as inserts before
+ * member g at 2g (in edit order), member j at 2j + 1 and appends last.
+ */
+typedef struct {
+    jsnnint_t from;
+    jsnnint_t to;
+    int lead_comma;
+    int trail_comma;
+    const jsnnpatch_t *edit;
+    int order; /* index in the edits array */
+    jsnnint_t container;
+    jsnnint_t index; /* member deleted, or inserted before; count to append */
+    jsnnint_t count; /* members of the container */
+    jsnnint_t prev_end; /* end of the member before, or -1 */
+    jsnnint_t next_start; /* start of the member after, or -1 */
+} jsnn_splice;
+
+/**
+ * Whether a member or non-append insert of container c survives after
+ * the item at position pos (see jsnn_splice).
+ */
+static
+int jsnn_patch_live_after(const jsnn_splice *sp, int num, jsnnint_t c,
+        jsnnint_t pos, int order) {
+    jsnnint_t first = (pos + 1) / 2, live = -1;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        if (sp[i].container != c)
+            continue;
+        if (live == -1)
+            live = sp[i].count - first;
+        if (sp[i].edit->op == JSNN_PATCH_DELETE) {
+            if (sp[i].index >= first)
+                live--;
+        } else if (sp[i].index < sp[i].count && (2 * sp[i].index > pos
+                    || (2 * sp[i].index == pos && sp[i].order > order))) {
+            return 1;
+        }
+    }
+    return live > 0;
+}
+
+/**
+ * Whether anything of container c survives ahead of the append with the
+ * given order.
+ */
+static
+int jsnn_patch_live_before_append(const jsnn_splice *sp, int num,
+        jsnnint_t c, int order) {
+    jsnnint_t live = -1;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        if (sp[i].container != c)
+            continue;
+        if (live == -1)
+            live = sp[i].count;
+        if (sp[i].edit->op == JSNN_PATCH_DELETE)
+            live--;
+        else if (sp[i].index < sp[i].count || sp[i].order < order)
+            return 1;
+    }
+    return live > 0;
+}
+
+static
+int jsnn_patch_deleted(const jsnn_splice *sp, int num, jsnnint_t c,
+        jsnnint_t index) {
+    int i;
+    for (i = 0; i < num; i++) {
+        if (sp[i].container == c && sp[i].index == index
+                && sp[i].edit->op == JSNN_PATCH_DELETE)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Find the member an edit applies to, walking its container once.
+ * Replacements need no member and get their final byte range here.
+ */
+static
+jsnnerr_t jsnn_patch_locate(jsnntok_t *tokens, jsnnint_t num_tokens,
+        const jsnnpatch_t *e, jsnn_splice *sp) {
+    jsnnint_t t, c, m, prev, k;
+
+    if (e->target == NULL)
+        return JSNN_ERROR_INVAL;
+    t = e->target - tokens;
+    if (t < 0 || t >= num_tokens)
+        return JSNN_ERROR_INVAL;
+
+    sp->edit = e;
+    sp->lead_comma = sp->trail_comma = 0;
+    sp->container = -1;
+    sp->prev_end = sp->next_start = -1;
+
+    if (e->op == JSNN_PATCH_REPLACE) {
+        sp->from = jsnn_span_start(&tokens[t]);
+        sp->to = jsnn_span_end(&tokens[t]);
+        return JSNN_SUCCESS;
+    }
+
+    if (e->op == JSNN_PATCH_DELETE) {
+        if ((c = tokens[t].parent) < 0)
+            return JSNN_ERROR_INVAL;
+    } else if (e->op == JSNN_PATCH_INSERT) {
+        c = t;
+        if (tokens[c].type == JSNN_OBJECT) {
+            if (e->key == NULL)
+                return JSNN_ERROR_INVAL;
+        } else if (tokens[c].type != JSNN_ARRAY) {
+            return JSNN_ERROR_INVAL;
+        }
+    } else {
+        return JSNN_ERROR_INVAL;
+    }
+    sp->container = c;
+    sp->count = tokens[c].type == JSNN_OBJECT ? tokens[c].size / 2 : tokens[c].size;
+
+    prev = -1;
+    for (m = jsnn_first_member(tokens, num_tokens, c), k = 0; m != -1;
+            m = jsnn_next_member(tokens, num_tokens, m), k++) {
+        if (e->op == JSNN_PATCH_DELETE ? (m == t || jsnn_member_last(tokens, m) == t)
+                : k == e->index) {
+            sp->index = k;
+            sp->from = sp->to = jsnn_span_start(&tokens[m]);
+            if (e->op == JSNN_PATCH_DELETE) {
+                sp->to = jsnn_span_end(&tokens[jsnn_member_last(tokens, m)]);
+                if ((t = jsnn_next_member(tokens, num_tokens, m)) != -1)
+                    sp->next_start = jsnn_span_start(&tokens[t]);
+            }
+            if (prev != -1)
+                sp->prev_end = jsnn_span_end(&tokens[jsnn_member_last(tokens, prev)]);
+            return JSNN_SUCCESS;
+        }
+        prev = m;
+    }
+    if (e->op == JSNN_PATCH_DELETE)
+        return JSNN_ERROR_INVAL;
+
+    /* Append */
+    sp->index = sp->count;
+    sp->from = sp->to = prev == -1 ? tokens[c].start + 1
+        : jsnn_span_end(&tokens[jsnn_member_last(tokens, prev)]);
+    return JSNN_SUCCESS;
+}
+
+/**
+ * Place commas so that every surviving item but the last of a container
+ * is followed by one. A deleted member takes the comma after it; if the
+ * member before survives with nothing after it, that member's comma goes
+ * too. Inserts bring their own comma: after them, or before an append.
+ */
+static
+void jsnn_patch_commas(jsnn_splice *sp, int num) {
+    jsnn_splice *d;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        d = &sp[i];
+        if (d->edit->op == JSNN_PATCH_DELETE) {
+            if (d->next_start != -1)
+                d->to = d->next_start;
+            if (d->prev_end != -1
+                    && !jsnn_patch_deleted(sp, num, d->container, d->index - 1)
+                    && !jsnn_patch_live_after(sp, num, d->container,
+                        2 * d->index - 1, 0))
+                d->from = d->prev_end;
+        } else if (d->edit->op == JSNN_PATCH_INSERT) {
+            if (d->index < d->count)
+                d->trail_comma = jsnn_patch_live_after(sp, num, d->container,
+                        2 * d->index, d->order);
+            else
+                d->lead_comma = jsnn_patch_live_before_append(sp, num,
+                        d->container, d->order);
+        }
+    }
+}
+
+jsnnint_t jsnn_patch(const char *js, jsnntok_t *tokens, jsnnuint_t num_tokens,
+        const jsnnpatch_t *edits, unsigned int num_edits,
+        char *out, jsnnuint_t out_len) {
+    jsnn_splice splices[JSNN_MAX_EDITS], tmp;
+    jsnn_outbuf b;
+    const jsnnpatch_t *e;
+    jsnnerr_t r;
+    jsnnint_t cursor;
+    int i, j;
+
+    if (num_edits > JSNN_MAX_EDITS)
+        return JSNN_ERROR_NOMEM;
+
+    for (i = 0; i < (int)num_edits; i++) {
+        r = jsnn_patch_locate(tokens, num_tokens, &edits[i], &splices[i]);
+        if (r < 0) return r;
+        splices[i].order = i;
+    }
+    jsnn_patch_commas(splices, num_edits);
+
+    /* Insertion sort by position; stable, so same-spot inserts keep order */
+    for (i = 1; i < (int)num_edits; i++) {
+        tmp = splices[i];
+        for (j = i - 1; j >= 0 && (splices[j].from > tmp.from
+                || (splices[j].from == tmp.from && splices[j].to > tmp.to)); j--)
+            splices[j + 1] = splices[j];
+        splices[j + 1] = tmp;
+    }
+
+    b.out = out;
+    b.cap = out == NULL ? 0 : out_len;
+    b.len = 0;
+    cursor = 0;
+    for (i = 0; i < (int)num_edits; i++) {
+        if (splices[i].from < cursor)
+            return JSNN_ERROR_INVAL;
+        jsnn_put(&b, js + cursor, splices[i].from - cursor);
+        e = splices[i].edit;
+        if (splices[i].lead_comma)
+            jsnn_put(&b, ",", 1);
+        if (e->op == JSNN_PATCH_INSERT && e->target->type == JSNN_OBJECT) {
+            jsnn_put(&b, "\"", 1);
+            jsnn_put(&b, e->key, e->key_len);
+            jsnn_put(&b, "\":", 2);
+        }
+        if (e->op != JSNN_PATCH_DELETE)
+            jsnn_put(&b, e->bytes, e->len);
+        if (splices[i].trail_comma)
+            jsnn_put(&b, ",", 1);
+        cursor = splices[i].to;
+    }
+    jsnn_put(&b, js + cursor, strlen(js + cursor));
+
+    if (b.len < b.cap)
+        out[b.len] = '\0';
+    return b.len;
+}
+
+
+static
+jsnnerr_t jsnn_bind_int(jsnntok_t *tok, const char *js, int64_t *out) {
+    const char *p = js + tok->start, *end = js + tok->end;
+    uint64_t v = 0, limit = INT64_MAX;
+    int neg = 0, d;
+
+    if (tok->type != JSNN_PRIMITIVE)
+        return JSNN_ERROR_INVAL;
+    if (p < end && *p == '-') {
+        neg = 1;
+        limit++;
+        p++;
+    }
+    if (p == end)
+        return JSNN_ERROR_INVAL;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9')
+            return JSNN_ERROR_INVAL;
+        d = *p - '0';
+        /* Refuse values that do not fit rather than wrap */
+        if (v > (limit - d) / 10)
+            return JSNN_ERROR_INVAL;
+        v = v * 10 + d;
+    }
+    *out = neg && v > 0 ? -(int64_t)(v - 1) - 1 : (int64_t)v;
+    return JSNN_SUCCESS;
+}
+
+static
+jsnnerr_t jsnn_bind_value(jsnntok_t *tok, const char *js,
+        const jsnn_bind *b, char *field);
+
+static
+jsnnerr_t jsnn_bind_fields(jsnntok_t *obj, const char *js,
+        const jsnn_bind *fields, int num_fields, char *base) {
+    jsnntok_t *key;
+    jsnnerr_t r;
+    jsnnint_t nattrs, i;
+    int j;
+
+    if (obj->type != JSNN_OBJECT)
+        return JSNN_ERROR_INVAL;
+
+    nattrs = obj->size / 2;
+    key = obj + 1;
+    for (i = 0; i < nattrs; i++) {
+        for (j = 0; j < num_fields; j++) {
+            if (jsnn_cmp(key, js, fields[j].name) == 0) {
+                r = jsnn_bind_value(key + 1, js, &fields[j],
+                        base + fields[j].offset);
+                if (r < 0) return r;
+                break;
+            }
+        }
+        key = jsnn_skip(key + 1);
+    }
+    return JSNN_SUCCESS;
+}
+
+static
+jsnnerr_t jsnn_bind_value(jsnntok_t *tok, const char *js,
+        const jsnn_bind *b, char *field) {
+    jsnntok_t *elem;
+    jsnnerr_t r;
+    char c;
+    jsnnint_t i;
+
+    c = js[tok->start];
+    if (tok->type == JSNN_PRIMITIVE && c == 'n')
+        return JSNN_SUCCESS;
+
+    switch (b->type) {
+    case JSNN_BIND_INT:
+        return jsnn_bind_int(tok, js, (int64_t *)field);
+    case JSNN_BIND_DOUBLE:
+        if (tok->type != JSNN_PRIMITIVE || !(c == '-' || (c >= '0' && c <= '9')))
+            return JSNN_ERROR_INVAL;
+        *(double *)field = strtod(js + tok->start, NULL);
+        return JSNN_SUCCESS;
+    case JSNN_BIND_BOOL:
+        if (tok->type != JSNN_PRIMITIVE || (c != 't' && c != 'f'))
+            return JSNN_ERROR_INVAL;
+        *(int *)field = c == 't';
+        return JSNN_SUCCESS;
+    case JSNN_BIND_STRING:
+        if (tok->type != JSNN_STRING)
+            return JSNN_ERROR_INVAL;
+        ((jsnn_str *)field)->ptr = js + tok->start;
+        ((jsnn_str *)field)->len = tok->end - tok->start;
+        return JSNN_SUCCESS;
+    case JSNN_BIND_OBJECT:
+        return jsnn_bind_fields(tok, js, b->fields, b->num_fields, field);
+    case JSNN_BIND_ARRAY:
+        if (tok->type != JSNN_ARRAY)
+            return JSNN_ERROR_INVAL;
+        elem = tok + 1;
+        for (i = 0; i < tok->size && i < b->num_fields; i++) {
+            r = jsnn_bind_value(elem, js, b->fields, field + i * b->stride);
+            if (r < 0) return r;
+            elem = jsnn_skip(elem);
+        }
+        *(int *)(field - b->offset + b->count) = i;
+        return JSNN_SUCCESS;
+    }
+    return JSNN_ERROR_INVAL;
+}
+
+jsnnerr_t jsnn_bind_struct(jsnntok_t *obj, const char *js,
+        const jsnn_bind *fields, int num_fields, void *out) {
+    return jsnn_bind_fields(obj, js, fields, num_fields, (char *)out);
+}
+
+
+void jsnn_writer_init(jsnn_writer *w, char *buf, jsnnuint_t cap,
+        jsnn_flush_cb flush, void *data) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->total = 0;
+    w->flush = flush;
+    w->data = data;
+    w->depth = 0;
+    w->after_key = 0;
+    w->done = 0;
+    w->err = JSNN_SUCCESS;
+}
+
+static
+jsnnerr_t jsnn_write_flush(jsnn_writer *w) {
+    if (w->flush == NULL || w->cap == 0)
+        return w->err = JSNN_ERROR_NOMEM;
+    if (w->len > 0 && w->flush(w->buf, w->len, w->data) != 0)
+        return w->err = JSNN_ERROR_INVAL;
+    w->len = 0;
+    return JSNN_SUCCESS;
+}
+
+/**
+ * Append raw bytes, flushing as often as needed for large runs.
+ */
+static
+jsnnerr_t jsnn_write_raw(jsnn_writer *w, const char *s, jsnnuint_t n) {
+    jsnnuint_t room;
+
+    for (;;) {
+        room = w->cap - w->len;
+        if (n <= room) {
+            memcpy(w->buf + w->len, s, n);
+            w->len += n;
+            w->total += n;
+            return JSNN_SUCCESS;
+        }
+        memcpy(w->buf + w->len, s, room);
+        w->len += room;
+        w->total += room;
+        s += room;
+        n -= room;
+        if (jsnn_write_flush(w) < 0)
+            return w->err;
+    }
+}
+
+/**
+ * Emit the separator due before a value (or, with key set, before a key)
+ * and check that it is allowed here.
+ */
+static
+jsnnerr_t jsnn_write_sep(jsnn_writer *w, int key) {
+    int in_object;
+
+    if (w->err < 0)
+        return w->err;
+    in_object = w->depth > 0 && w->open[w->depth - 1] == JSNN_OBJECT;
+    if (key ? !in_object || w->after_key : in_object && !w->after_key)
+        return w->err = JSNN_ERROR_INVAL;
+    if (w->after_key) {
+        w->after_key = 0;
+        return JSNN_SUCCESS;
+    }
+    if (w->depth > 0) {
+        if (!w->empty[w->depth - 1])
+            return jsnn_write_raw(w, ",", 1);
+        w->empty[w->depth - 1] = 0;
+    } else {
+        /* A document has exactly one root value */
+        if (w->done)
+            return w->err = JSNN_ERROR_INVAL;
+        w->done = 1;
+    }
+    return JSNN_SUCCESS;
+}
+
+static
+jsnnerr_t jsnn_write_open(jsnn_writer *w, jsnntype_t type) {
+    if (jsnn_write_sep(w, 0) < 0)
+        return w->err;
+    if (w->depth == JSNN_MAX_DEPTH)
+        return w->err = JSNN_ERROR_INVAL;
+    w->open[w->depth] = type;
+    w->empty[w->depth] = 1;
+    w->depth++;
+    return jsnn_write_raw(w, type == JSNN_OBJECT ? "{" : "[", 1);
+}
+
+static
+jsnnerr_t jsnn_write_close(jsnn_writer *w, jsnntype_t type) {
+    if (w->err < 0)
+        return w->err;
+    if (w->depth == 0 || w->open[w->depth - 1] != type || w->after_key)
+        return w->err = JSNN_ERROR_INVAL;
+    w->depth--;
+    return jsnn_write_raw(w, type == JSNN_OBJECT ? "}" : "]", 1);
+}
+
+jsnnerr_t jsnn_write_begin_object(jsnn_writer *w) {
+    return jsnn_write_open(w, JSNN_OBJECT);
+}
+
+jsnnerr_t jsnn_write_end_object(jsnn_writer *w) {
+    return jsnn_write_close(w, JSNN_OBJECT);
+}
+
+jsnnerr_t jsnn_write_begin_array(jsnn_writer *w) {
+    return jsnn_write_open(w, JSNN_ARRAY);
+}
+
+jsnnerr_t jsnn_write_end_array(jsnn_writer *w) {
+    return jsnn_write_close(w, JSNN_ARRAY);
+}
+
+/**
+ * Nonzero if any of the 8 bytes in x is a control character, a quote or a
+ * backslash (the classic "has byte less than / has zero byte" SWAR tests).
+ */
+#define JSNN_ONES 0x0101010101010101ull
+#define JSNN_HIGHS 0x8080808080808080ull
+#define JSNN_HAS_ZERO(x) (((x) - JSNN_ONES) & ~(x) & JSNN_HIGHS)
+#define JSNN_NEEDS_ESCAPE(x) \
+    ((((x) - JSNN_ONES * 0x20) & ~(x) & JSNN_HIGHS) \
+     | JSNN_HAS_ZERO((x) ^ (JSNN_ONES * '"')) \
+     | JSNN_HAS_ZERO((x) ^ (JSNN_ONES * '\\')))
+
+static
+jsnnerr_t jsnn_write_escaped(jsnn_writer *w, const char *s, jsnnint_t len) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = s, *end = s + len;
+    char esc[6];
+    uint64_t x;
+    unsigned char c;
+
+    if (jsnn_write_raw(w, "\"", 1) < 0)
+        return w->err;
+    while (s < end) {
+        /* Skip 8 bytes at a time while nothing needs escaping */
+        while (end - s >= 8) {
+            memcpy(&x, s, 8);
+            if (JSNN_NEEDS_ESCAPE(x))
+                break;
+            s += 8;
+        }
+        if (s == end)
+            break;
+        c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            s++;
+            continue;
+        }
+        if (jsnn_write_raw(w, run, s - run) < 0)
+            return w->err;
+        esc[0] = '\\';
+        switch (c) {
+        case '"': esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 15];
+            if (jsnn_write_raw(w, esc, 6) < 0)
+                return w->err;
+            run = ++s;
+            continue;
+        }
+        if (jsnn_write_raw(w, esc, 2) < 0)
+            return w->err;
+        run = ++s;
+    }
+    if (jsnn_write_raw(w, run, end - run) < 0)
+        return w->err;
+    return jsnn_write_raw(w, "\"", 1);
+}
+
+jsnnerr_t jsnn_write_key(jsnn_writer *w, const char *s, jsnnint_t len) {
+    if (jsnn_write_sep(w, 1) < 0)
+        return w->err;
+    if (jsnn_write_escaped(w, s, len) < 0 || jsnn_write_raw(w, ":", 1) < 0)
+        return w->err;
+    w->after_key = 1;
+    return JSNN_SUCCESS;
+}
+
+jsnnerr_t jsnn_write_string(jsnn_writer *w, const char *s, jsnnint_t len) {
+    if (jsnn_write_sep(w, 0) < 0)
+        return w->err;
+    return jsnn_write_escaped(w, s, len);
+}
+
+jsnnerr_t jsnn_write_int(jsnn_writer *w, int64_t v) {
+    char digits[20], *p = digits + sizeof(digits);
+    uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+
+    if (jsnn_write_sep(w, 0) < 0)
+        return w->err;
+    do {
+        *--p = '0' + (char)(u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (v < 0)
+        *--p = '-';
+    return jsnn_write_raw(w, p, digits + sizeof(digits) - p);
+}
+
+/**
+ * Doubles are written with the fewest of 15, 16 or 17 significant digits
+ * that reads back as the same value.
+ */
+jsnnerr_t jsnn_write_double(jsnn_writer *w, double v) {
+    char num[32];
+    int n, prec;
+
+    if (jsnn_write_sep(w, 0) < 0)
+        return w->err;
+    if (v != v || v - v != 0)
+        return w->err = JSNN_ERROR_INVAL;
+    for (prec = 15; prec < 17; prec++) {
+        n = snprintf(num, sizeof(num), "%.*g", prec, v);
+        if (strtod(num, NULL) == v)
+            break;
+    }
+    if (prec == 17)
+        n = snprintf(num, sizeof(num), "%.17g", v);
+    return jsnn_write_raw(w, num, n);
+}
+
+jsnnerr_t jsnn_write_bool(jsnn_writer *w, int v) {
+    if (jsnn_write_sep(w, 0) < 0)
+        return w->err;
+    return v ? jsnn_write_raw(w, "true", 4) : jsnn_write_raw(w, "false", 5);
+}
+
+jsnnerr_t jsnn_write_null(jsnn_writer *w) {
+    if (jsnn_write_sep(w, 0) < 0)
+        return w->err;
+    return jsnn_write_raw(w, "null", 4);
+}
+
+jsnnerr_t jsnn_write_finish(jsnn_writer *w) {
+    if (w->err < 0)
+        return w->err;
+    if (w->depth != 0 || w->after_key)
+        return w->err = JSNN_ERROR_INVAL;
+    if (w->flush != NULL)
+        return jsnn_write_flush(w);
+    if (w->len < w->cap)
+        w->buf[w->len] = '\0';
+    return JSNN_SUCCESS;
+}
+
+#define JSNN_HASH_K1 0x9e3779b97f4a7c15ULL
+#define JSNN_HASH_K2 0xc2b2ae3d27d4eb4fULL
+
+/**
+ * Final mix of splitmix64: every input bit affects every output bit.
+ */
+static
+uint64_t jsnn_mix64(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/**
+ * Hash a string or primitive, eight bytes at a time, seeded by its type so
+ * that "true" and true differ.
+ */
+static
+jsnnhash_t jsnn_hash_scalar(const char *s, jsnnint_t len, jsnntype_t type) {
+    jsnnhash_t h;
+    uint64_t w;
+
+    h.lo = jsnn_mix64(JSNN_HASH_K1 ^ (uint64_t)type);
+    h.hi = jsnn_mix64(JSNN_HASH_K2 ^ (uint64_t)type);
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&w, s, 8);
+        h.lo = jsnn_mix64(h.lo ^ w);
+        h.hi = jsnn_mix64(h.hi + w * JSNN_HASH_K1);
+    }
+    w = (uint64_t)len << 56;
+    memcpy(&w, s, len);
+    h.lo = jsnn_mix64(h.lo ^ w);
+    h.hi = jsnn_mix64(h.hi + w * JSNN_HASH_K1);
+    return h;
+}
+
+/**
+ * A container whose hash is being accumulated. Array elements are folded
+ * in order; object members are hashed with their keys and summed, so
+ * member order does not matter.
+ */
+typedef struct {
+    jsnnint_t tok;
+    jsnnint_t count;
+    jsnnhash_t acc;
+    jsnnhash_t key; /* key of the member whose value is pending */
+} jsnn_hash_frame;
+
+static
+void jsnn_hash_add(jsnntok_t *tokens, jsnn_hash_frame *f, jsnnhash_t h) {
+    if (tokens[f->tok].type == JSNN_ARRAY) {
+        f->acc.lo = jsnn_mix64(f->acc.lo + h.lo + JSNN_HASH_K1);
+        f->acc.hi = jsnn_mix64(f->acc.hi + h.hi + JSNN_HASH_K2);
+    } else if (f->count % 2 == 0) {
+        f->key = h;
+    } else {
+        f->acc.lo += jsnn_mix64(f->key.lo ^ jsnn_mix64(h.lo + JSNN_HASH_K1));
+        f->acc.hi += jsnn_mix64(f->key.hi ^ jsnn_mix64(h.hi + JSNN_HASH_K2));
+    }
+    f->count++;
+}
+
+static
+jsnnhash_t jsnn_hash_end(jsnntok_t *tokens, jsnn_hash_frame *f) {
+    jsnnhash_t h;
+    uint64_t tag = (uint64_t)tokens[f->tok].type << 56 ^ (uint64_t)f->count;
+
+    h.lo = jsnn_mix64(f->acc.lo ^ tag);
+    h.hi = jsnn_mix64(f->acc.hi ^ tag * JSNN_HASH_K1);
+    return h;
+}
+
+/**
+ * Tokens are in document order, so a container's subtree ends at the first
+ * token whose parent is not inside it. Open containers are kept on a
+ * stack; nothing is revisited.
+ */
+jsnnerr_t jsnn_hash(const char *js, jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnnhash_t *hashes) {
+    jsnn_hash_frame stack[JSNN_MAX_DEPTH];
+    jsnn_hash_frame *f;
+    jsnntok_t *t;
+    jsnnint_t i;
+    int depth = 0;
+
+    for (i = 0; i <= num_tokens; i++) {
+        t = &tokens[i];
+        while (depth > 0 && (i == num_tokens || stack[depth - 1].tok != t->parent)) {
+            f = &stack[--depth];
+            hashes[f->tok] = jsnn_hash_end(tokens, f);
+            if (depth > 0)
+                jsnn_hash_add(tokens, &stack[depth - 1], hashes[f->tok]);
+        }
+        if (i == num_tokens)
+            break;
+        if (t->type == JSNN_OBJECT || t->type == JSNN_ARRAY) {
+            if (depth == JSNN_MAX_DEPTH)
+                return JSNN_ERROR_NOMEM;
+            f = &stack[depth++];
+            f->tok = i;
+            f->count = 0;
+            f->acc.lo = f->acc.hi = 0;
+            continue;
+        }
+        hashes[i] = jsnn_hash_scalar(js + t->start, t->end - t->start, t->type);
+        if (depth > 0)
+            jsnn_hash_add(tokens, &stack[depth - 1], hashes[i]);
+    }
+    return JSNN_SUCCESS;
+}
+
+typedef struct {
+    const char *js[2];
+    jsnntok_t *tokens[2];
+    const jsnnhash_t *hashes[2];
+    jsnn_diff_cb cb;
+    void *data;
+    char path[JSNN_MAX_PATH];
+    int stop;
+    jsnnerr_t err;
+} jsnn_diff_ctx;
+
+static
+int jsnn_hash_eq(const jsnn_diff_ctx *ctx, jsnntok_t *a, jsnntok_t *b,
+        int side_b) {
+    const jsnnhash_t *ha = &ctx->hashes[!side_b][a - ctx->tokens[!side_b]];
+    const jsnnhash_t *hb = &ctx->hashes[side_b][b - ctx->tokens[side_b]];
+    return ha->lo == hb->lo && ha->hi == hb->hi;
+}
+
+/**
+ * Find the member of obj (on side) whose key equals key (from the other
+ * side), scanning from *cursor and wrapping around; on a match *cursor
+ * moves past it, so members in the same order are found immediately.
+ */
+static
+jsnntok_t *jsnn_diff_find(const jsnn_diff_ctx *ctx, int side, jsnntok_t *key,
+        jsnntok_t *obj, jsnntok_t **cursor, jsnnint_t *cursor_index) {
+    jsnnint_t n = obj->size / 2, i = *cursor_index, tries;
+    jsnntok_t *k = *cursor;
+    jsnnint_t len = key->end - key->start;
+
+    for (tries = 0; tries < n; tries++) {
+        if (jsnn_hash_eq(ctx, key, k, side) && k->end - k->start == len
+                && memcmp(ctx->js[side] + k->start, ctx->js[!side] + key->start,
+                    len) == 0) {
+            *cursor = jsnn_skip(k + 1);
+            *cursor_index = i + 1;
+            if (*cursor_index == n) {
+                *cursor = obj + 1;
+                *cursor_index = 0;
+            }
+            return k;
+        }
+        k = jsnn_skip(k + 1);
+        if (++i == n) {
+            k = obj + 1;
+            i = 0;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * True if the key reads back as a bare name in jsnn_compile_name.
+ */
+static
+int jsnn_diff_bare(const char *name, jsnnuint_t len) {
+    jsnnuint_t i;
+
+    if (len == 0 || name[0] == '*')
+        return 0;
+    for (i = 0; i < len; i++) {
+        switch (name[i]) {
+        case '.': case '[': case '\t': case '\r': case '\n': case ' ':
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Append ".key" (or "key" at the root), "['key']" for keys that are not
+ * valid bare names, or "[index]" to the path.
+ */
+static
+size_t jsnn_diff_push(jsnn_diff_ctx *ctx, size_t plen, const char *js,
+        jsnntok_t *key, jsnnint_t index) {
+    int n;
+
+    if (key != NULL && jsnn_diff_bare(js + key->start, key->end - key->start))
+        n = snprintf(ctx->path + plen, JSNN_MAX_PATH - plen, "%s%.*s",
+                plen > 0 ? "." : "", (int)(key->end - key->start), js + key->start);
+    else if (key != NULL)
+        n = snprintf(ctx->path + plen, JSNN_MAX_PATH - plen, "['%.*s']",
+                (int)(key->end - key->start), js + key->start);
+    else
+        n = snprintf(ctx->path + plen, JSNN_MAX_PATH - plen, "[%ld]",
+                (long)index);
+    if (n < 0 || (size_t)n >= JSNN_MAX_PATH - plen) {
+        ctx->err = JSNN_ERROR_NOMEM;
+        ctx->stop = 1;
+        return plen;
+    }
+    return plen + n;
+}
+
+static
+void jsnn_diff_report(jsnn_diff_ctx *ctx, jsnndiff_t kind, jsnntok_t *a,
+        jsnntok_t *b) {
+    if (!ctx->stop)
+        ctx->stop = ctx->cb(kind, ctx->path, a, b, ctx->data);
+}
+
+static
+void jsnn_diff_walk(jsnn_diff_ctx *ctx, jsnntok_t *a, jsnntok_t *b,
+        size_t plen) {
+    jsnntok_t *ka, *kb, *cursor;
+    jsnnint_t n, i, cursor_index;
+    size_t sub;
+
+    if (jsnn_hash_eq(ctx, a, b, 1))
+        return;
+    if (a->type != b->type
+            || (a->type != JSNN_OBJECT && a->type != JSNN_ARRAY)) {
+        jsnn_diff_report(ctx, JSNN_DIFF_CHANGED, a, b);
+        return;
+    }
+
+    if (a->type == JSNN_ARRAY) {
+        ka = a + 1;
+        kb = b + 1;
+        for (i = 0; !ctx->stop && (i < a->size || i < b->size); i++) {
+            sub = jsnn_diff_push(ctx, plen, NULL, NULL, i);
+            if (i >= b->size) {
+                jsnn_diff_report(ctx, JSNN_DIFF_REMOVED, ka, NULL);
+            } else if (i >= a->size) {
+                jsnn_diff_report(ctx, JSNN_DIFF_ADDED, NULL, kb);
+            } else {
+                jsnn_diff_walk(ctx, ka, kb, sub);
+            }
+            if (i < a->size)
+                ka = jsnn_skip(ka);
+            if (i < b->size)
+                kb = jsnn_skip(kb);
+        }
+        ctx->path[plen] = '\0';
+        return;
+    }
+
+    /* Members of a, changed or removed */
+    cursor = b + 1;
+    cursor_index = 0;
+    ka = a + 1;
+    for (n = a->size / 2; n > 0 && !ctx->stop; n--) {
+        sub = jsnn_diff_push(ctx, plen, ctx->js[0], ka, 0);
+        kb = jsnn_diff_find(ctx, 1, ka, b, &cursor, &cursor_index);
+        if (kb != NULL)
+            jsnn_diff_walk(ctx, ka + 1, kb + 1, sub);
+        else
+            jsnn_diff_report(ctx, JSNN_DIFF_REMOVED, ka + 1, NULL);
+        ctx->path[plen] = '\0';
+        ka = jsnn_skip(ka + 1);
+    }
+
+    /* Members only in b */
+    cursor = a + 1;
+    cursor_index = 0;
+    kb = b + 1;
+    for (n = b->size / 2; n > 0 && !ctx->stop; n--) {
+        if (jsnn_diff_find(ctx, 0, kb, a, &cursor, &cursor_index) == NULL) {
+            jsnn_diff_push(ctx, plen, ctx->js[1], kb, 0);
+            jsnn_diff_report(ctx, JSNN_DIFF_ADDED, NULL, kb + 1);
+            ctx->path[plen] = '\0';
+        }
+        kb = jsnn_skip(kb + 1);
+    }
+}
+
+jsnnerr_t jsnn_diff(const char *js_a, jsnntok_t *tokens_a,
+        const jsnnhash_t *hashes_a,
+        const char *js_b, jsnntok_t *tokens_b, const jsnnhash_t *hashes_b,
+        jsnn_diff_cb cb, void *data) {
+    jsnn_diff_ctx ctx;
+
+    ctx.js[0] = js_a;
+    ctx.js[1] = js_b;
+    ctx.tokens[0] = tokens_a;
+    ctx.tokens[1] = tokens_b;
+    ctx.hashes[0] = hashes_a;
+    ctx.hashes[1] = hashes_b;
+    ctx.cb = cb;
+    ctx.data = data;
+    ctx.path[0] = '\0';
+    ctx.stop = 0;
+    ctx.err = JSNN_SUCCESS;
+    jsnn_diff_walk(&ctx, tokens_a, tokens_b, 0);
+    return ctx.err;
+}
+
+void jsnn_agg_init(jsnn_agg *agg) {
+    memset(agg, 0, sizeof(*agg));
+}
+
+/**
+ * Natural logarithm, to keep the core free of libm: reduce x to [1, 2)
+ * and sum the series for 2 atanh((x - 1) / (x + 1)).
+ */
+static
+double jsnn_ln(double x) {
+    double y, y2, term, sum = 0;
+    int k = 0, n;
+
+    for (; x >= 2; x /= 2)
+        k++;
+    for (; x < 1; x *= 2)
+        k--;
+    y = (x - 1) / (x + 1);
+    y2 = y * y;
+    for (term = y, n = 1; n < 40; n += 2, term *= y2)
+        sum += term / n;
+    return 2 * sum + k * 0.6931471805599453;
+}
+
+double jsnn_agg_distinct(const jsnn_agg *agg) {
+    const double m = 1 << JSNN_AGG_BITS;
+    double sum = 0, estimate;
+    int i, zeros = 0;
+
+    for (i = 0; i < (1 << JSNN_AGG_BITS); i++) {
+        sum += 1.0 / (double)((uint64_t)1 << agg->registers[i]);
+        zeros += agg->registers[i] == 0;
+    }
+    estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    /* Small cardinalities are better counted by empty registers */
+    if (estimate <= 2.5 * m && zeros > 0)
+        estimate = m * jsnn_ln(m / zeros);
+    return estimate;
+}
+
+static
+void jsnn_agg_add(jsnn_agg *agg, const char *s, jsnnint_t len, jsnntype_t type) {
+    char num[64];
+    uint64_t h, w;
+    double v;
+    int rank;
+
+    if (type == JSNN_PRIMITIVE && len == 4 && memcmp(s, "null", 4) == 0)
+        return;
+    agg->count++;
+    if (type != JSNN_STRING && type != JSNN_PRIMITIVE)
+        return;
+
+    /* The top bits pick a register, which keeps the longest run of
+     * leading zeros (plus one) seen in the rest */
+    h = jsnn_hash_scalar(s, len, type).lo;
+    w = h << JSNN_AGG_BITS;
+    for (rank = 1; rank <= 64 - JSNN_AGG_BITS && !(w >> 63); rank++)
+        w <<= 1;
+    if (agg->registers[h >> (64 - JSNN_AGG_BITS)] < rank)
+        agg->registers[h >> (64 - JSNN_AGG_BITS)] = (unsigned char)rank;
+
+    if (type == JSNN_PRIMITIVE && (s[0] == '-' || (s[0] >= '0' && s[0] <= '9'))
+            && len < (jsnnint_t)sizeof(num)) {
+        memcpy(num, s, len);
+        num[len] = '\0';
+        v = strtod(num, NULL);
+        if (agg->numbers == 0 || v < agg->min)
+            agg->min = v;
+        if (agg->numbers == 0 || v > agg->max)
+            agg->max = v;
+        agg->sum += v;
+        agg->numbers++;
+    }
+}
+
+typedef struct {
+    const char *js;
+    jsnnuint_t len;
+    jsnnuint_t pos;
+    const jsnn_path *path;
+    jsnn_agg *agg;
+} jsnn_scanner;
+
+static
+void jsnn_scan_ws(jsnn_scanner *s) {
+    while (s->pos < s->len && (s->js[s->pos] == ' ' || s->js[s->pos] == '\t'
+                || s->js[s->pos] == '\n' || s->js[s->pos] == '\r'))
+        s->pos++;
+}
+
+/**
+ * Move past a string whose opening quote is at pos.
+ */
+static
+jsnnerr_t jsnn_scan_string(jsnn_scanner *s) {
+    for (s->pos++; s->pos < s->len; s->pos++) {
+        if (s->js[s->pos] == '\\')
+            s->pos++;
+        else if (s->js[s->pos] == '"')
+            break;
+    }
+    if (s->pos >= s->len)
+        return JSNN_ERROR_PART;
+    s->pos++;
+    return JSNN_SUCCESS;
+}
+
+/**
+ * Move past the bracket closing depth levels of open containers, looking
+ * at nothing but strings and brackets on the way.
+ */
+static
+jsnnerr_t jsnn_scan_close(jsnn_scanner *s, int depth) {
+    char c;
+
+    while (s->pos < s->len) {
+        c = s->js[s->pos];
+        if (c == '"') {
+            if (jsnn_scan_string(s) != JSNN_SUCCESS)
+                return JSNN_ERROR_PART;
+            continue;
+        }
+        s->pos++;
+        if (c == '{' || c == '[')
+            depth++;
+        else if ((c == '}' || c == ']') && --depth == 0)
+            return JSNN_SUCCESS;
+    }
+    return JSNN_ERROR_PART;
+}
+
+/**
+ * Move past the value at pos, adding it to the aggregates if found.
+ */
+static
+jsnnerr_t jsnn_scan_skip(jsnn_scanner *s, int found) {
+    jsnnuint_t start = s->pos;
+    jsnnerr_t r;
+    char c = s->js[s->pos];
+
+    if (c == '"') {
+        r = jsnn_scan_string(s);
+        if (r == JSNN_SUCCESS && found)
+            jsnn_agg_add(s->agg, s->js + start + 1, s->pos - start - 2, JSNN_STRING);
+        return r;
+    }
+    if (c == '{' || c == '[') {
+        s->pos++;
+        r = jsnn_scan_close(s, 1);
+        if (r == JSNN_SUCCESS && found)
+            jsnn_agg_add(s->agg, s->js + start, s->pos - start,
+                    c == '{' ? JSNN_OBJECT : JSNN_ARRAY);
+        return r;
+    }
+    if (c == '}' || c == ']' || c == ',' || c == ':')
+        return JSNN_ERROR_INVAL;
+    for (; s->pos < s->len; s->pos++) {
+        c = s->js[s->pos];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r'
+                || c == ',' || c == '}' || c == ']')
+            break;
+    }
+    if (found)
+        jsnn_agg_add(s->agg, s->js + start, s->pos - start, JSNN_PRIMITIVE);
+    return JSNN_SUCCESS;
+}
+
+/**
+ * Expect ',' or the closing bracket after a member or element. Returns 1
+ * at the closing bracket.
+ */
+static
+int jsnn_scan_next(jsnn_scanner *s, char close, jsnnerr_t *r) {
+    jsnn_scan_ws(s);
+    if (s->pos >= s->len) {
+        *r = JSNN_ERROR_PART;
+        return 1;
+    }
+    if (s->js[s->pos] == close) {
+        s->pos++;
+        return 1;
+    }
+    if (s->js[s->pos] != ',') {
+        *r = JSNN_ERROR_INVAL;
+        return 1;
+    }
+    s->pos++;
+    return 0;
+}
+
+/**
+ * Follow the path from step into the value at pos. Only containers on
+ * the path are walked member by member; once a key or index step has
+ * matched, the rest of its container is skipped by bracket counting.
+ */
+static
+jsnnerr_t jsnn_scan_value(jsnn_scanner *s, int step) {
+    const jsnn_step *st = &s->path->steps[step];
+    jsnnuint_t key, key_len;
+    jsnnint_t index;
+    jsnnerr_t r = JSNN_SUCCESS;
+    char c;
+
+    jsnn_scan_ws(s);
+    if (s->pos >= s->len)
+        return JSNN_ERROR_PART;
+    c = s->js[s->pos];
+    if (step == s->path->num_steps)
+        return jsnn_scan_skip(s, 1);
+
+    if (c == '{' && (st->kind == JSNN_STEP_KEY || st->kind == JSNN_STEP_ANY)) {
+        s->pos++;
+        jsnn_scan_ws(s);
+        if (s->pos < s->len && s->js[s->pos] == '}') {
+            s->pos++;
+            return JSNN_SUCCESS;
+        }
+        do {
+            jsnn_scan_ws(s);
+            if (s->pos >= s->len)
+                return JSNN_ERROR_PART;
+            if (s->js[s->pos] != '"')
+                return JSNN_ERROR_INVAL;
+            key = s->pos + 1;
+            if ((r = jsnn_scan_string(s)) != JSNN_SUCCESS)
+                return r;
+            key_len = s->pos - 1 - key;
+            jsnn_scan_ws(s);
+            if (s->pos >= s->len)
+                return JSNN_ERROR_PART;
+            if (s->js[s->pos++] != ':')
+                return JSNN_ERROR_INVAL;
+            if (st->kind == JSNN_STEP_ANY) {
+                r = jsnn_scan_value(s, step + 1);
+            } else if (key_len == (jsnnuint_t)st->len
+                    && memcmp(s->js + key, st->name, st->len) == 0) {
+                if ((r = jsnn_scan_value(s, step + 1)) != JSNN_SUCCESS)
+                    return r;
+                return jsnn_scan_close(s, 1);
+            } else {
+                jsnn_scan_ws(s);
+                r = s->pos < s->len ? jsnn_scan_skip(s, 0) : JSNN_ERROR_PART;
+            }
+            if (r != JSNN_SUCCESS)
+                return r;
+        } while (!jsnn_scan_next(s, '}', &r));
+        return r;
+    }
+
+    if (c == '[' && (st->kind == JSNN_STEP_INDEX || st->kind == JSNN_STEP_ANY)) {
+        s->pos++;
+        jsnn_scan_ws(s);
+        if (s->pos < s->len && s->js[s->pos] == ']') {
+            s->pos++;
+            return JSNN_SUCCESS;
+        }
+        index = 0;
+        do {
+            if (st->kind == JSNN_STEP_ANY) {
+                r = jsnn_scan_value(s, step + 1);
+            } else if (index == st->index) {
+                if ((r = jsnn_scan_value(s, step + 1)) != JSNN_SUCCESS)
+                    return r;
+                return jsnn_scan_close(s, 1);
+            } else {
+                jsnn_scan_ws(s);
+                r = s->pos < s->len ? jsnn_scan_skip(s, 0) : JSNN_ERROR_PART;
+            }
+            if (r != JSNN_SUCCESS)
+                return r;
+            index++;
+        } while (!jsnn_scan_next(s, ']', &r));
+        return r;
+    }
+
+    return jsnn_scan_skip(s, 0);
+}
+
+jsnnerr_t jsnn_scan(const char *js, jsnnuint_t len, const jsnn_path *path,
+        jsnn_agg *agg) {
+    jsnn_scanner s;
+    jsnnerr_t r;
+    int i;
+
+    for (i = 0; i < path->num_steps; i++) {
+        if (path->steps[i].kind != JSNN_STEP_KEY
+                && path->steps[i].kind != JSNN_STEP_INDEX
+                && path->steps[i].kind != JSNN_STEP_ANY)
+            return JSNN_ERROR_INVAL;
+    }
+    s.js = js;
+    s.len = len;
+    s.pos = 0;
+    s.path = path;
+    s.agg = agg;
+    for (;;) {
+        jsnn_scan_ws(&s);
+        if (s.pos >= len)
+            return JSNN_SUCCESS;
+        r = jsnn_scan_value(&s, 0);
+        if (r != JSNN_SUCCESS)
+            return r;
+        agg->records++;
+    }
+}
@@ -1,10 +1,46 @@
 #ifndef __JSNN_H_
 #define __JSNN_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifndef JSNN_MAX_DEPTH
     #define JSNN_MAX_DEPTH 128
 #endif
 
+#ifndef JSNN_MAX_STEPS
+    #define JSNN_MAX_STEPS 32
+#endif
+
+#ifndef JSNN_MAX_EDITS
+    #define JSNN_MAX_EDITS 64
+#endif
+
+#ifndef JSNN_MAX_PATH
+    #define JSNN_MAX_PATH 512
+#endif
+
+#ifndef JSNN_AGG_BITS
+    #define JSNN_AGG_BITS 10
+#endif
+
+/**
+ * Offsets, sizes and token indices. These are 32-bit by default to keep
+ * tokens compact; define JSNN_LARGE to make them 64-bit for documents of
+ * 2 GB or more.
+ */
+#ifdef JSNN_LARGE
+typedef int64_t jsnnint_t;
+typedef uint64_t jsnnuint_t;
+#else
+typedef int jsnnint_t;
+typedef unsigned int jsnnuint_t;
+#endif
+
 /**
  * JSON type identifier. Basic types are:
  * 	o Object
@@ -44,24 +80,51 @@ typedef enum {
  * @param       pair_type   pair type (name or value)
  * @param		start	    start position in JSON data string
  * @param		end		    end position in JSON data string
+ * @param       key         interned id of a name token, or -1; for a
+ *                          container reordered by jsnn_relayout, the index
+ *                          of its first child
  */
 typedef struct {
 	jsnntype_t type;
     jsnnpair_t pair_type;
-	int start;
-	int end;
-	int size;
-	int parent;
+	jsnnint_t start;
+	jsnnint_t end;
+	jsnnint_t size;
+	jsnnint_t parent;
+	int key;
 } jsnntok_t;
 
+/**
+ * Slot of a key intern table. Keys are stored as the raw bytes that appear
+ * between the quotes in the JSON (escapes are not decoded).
+ */
+typedef struct {
+    const char *key;
+    int len;
+    unsigned int hash;
+    int id;
+} jsnn_intern_entry;
+
+/**
+ * Key intern table. Maps a fixed set of known keys to small integer ids.
+ * Storage is provided by the caller and the table is only read while
+ * parsing, so one table can be shared by any number of parsers.
+ */
+typedef struct {
+    jsnn_intern_entry *entries;
+    unsigned int num_entries; /* capacity, a power of two */
+    int num_keys;
+} jsnn_intern;
+
 /**
  * JSON parser. Contains an array of token blocks available. Also stores
  * the string being parsed now and current position in that string
  */
 typedef struct {
-	unsigned int pos; /* offset in the JSON string */
-	int toknext; /* next token to allocate */
-	int toksuper; /* superior token node, e.g parent object or array */
+	jsnnuint_t pos; /* offset in the JSON string */
+	jsnnint_t toknext; /* next token to allocate */
+	jsnnint_t toksuper; /* superior token node, e.g parent object or array */
+	const jsnn_intern *intern; /* optional key intern table */
 } jsnn_parser;
 
 /**
@@ -74,17 +137,333 @@ void jsnn_init(jsnn_parser *parser);
  * a single JSON object.
  */
 jsnnerr_t jsnn_parse(jsnn_parser *parser, const char *js, 
-		jsnntok_t *tokens, unsigned int num_tokens);
+		jsnntok_t *tokens, jsnnuint_t num_tokens);
+
+/**
+ * Like jsnn_parse, but stops after len bytes, so js need not be
+ * NUL-terminated (e.g. one record in a larger buffer).
+ */
+jsnnerr_t jsnn_parse_len(jsnn_parser *parser, const char *js, jsnnuint_t len,
+		jsnntok_t *tokens, jsnnuint_t num_tokens);
+
+/**
+ * Update the tokens of a successfully parsed document after an edit,
+ * re-tokenizing only the smallest object or array that encloses it. The
+ * edit replaced bytes [start, old_end) of the old text with bytes
+ * [start, new_end) of js, the new text. The result is identical to a full
+ * jsnn_parse of js; edits not inside any container fall back to one.
+ *
+ * The new subtree is tokenized into the unused tokens past
+ * parser->toknext, so on JSNN_ERROR_NOMEM the existing tokens are intact.
+ */
+jsnnerr_t jsnn_reparse(jsnn_parser *parser, const char *js,
+		jsnntok_t *tokens, jsnnuint_t num_tokens,
+		jsnnint_t start, jsnnint_t old_end, jsnnint_t new_end);
+
+/**
+ * Path step kinds. Paths are a dotted javascript-style syntax:
+ * 	o Key: "name", ".name" or "['name']"
+ * 	o Index: "[2]"
+ * 	o Any: ".*" or "[*]", every member value or array element
+ * 	o Descend: "..name", that key at any depth below
+ * 	o Descend any: "..*", every value at any depth below
+ * 	o Filter: "[?(@.status == 'active' && @.age > 2)]", every member value
+ * 	  or array element for which the predicate holds. Predicates support
+ * 	  ==, !=, <, <=, >, >= on strings and numbers, &&, ||, !, parentheses
+ * 	  and existence tests such as "[?(@.owner)]".
+ */
+typedef enum {
+    JSNN_STEP_KEY = 0,
+    JSNN_STEP_INDEX = 1,
+    JSNN_STEP_ANY = 2,
+    JSNN_STEP_DESCEND = 3,
+    JSNN_STEP_DESCEND_ANY = 4,
+    JSNN_STEP_FILTER = 5
+} jsnnstep_t;
+
+typedef struct {
+    jsnnstep_t kind;
+    const char *name;
+    int len;
+    jsnnint_t index;
+} jsnn_step;
+
+/**
+ * A compiled path. Names point into the path string, which must outlive
+ * the compiled path.
+ */
+typedef struct {
+    jsnn_step steps[JSNN_MAX_STEPS];
+    int num_steps;
+} jsnn_path;
+
+/**
+ * Called for each match; return nonzero to stop the traversal.
+ */
+typedef int (*jsnn_select_cb)(jsnntok_t *tok, void *data);
+
+/**
+ * Events reported by the event-driven (SAX-style) parser.
+ */
+typedef enum {
+    JSNN_EVENT_BEGIN_OBJECT = 0,
+    JSNN_EVENT_END_OBJECT = 1,
+    JSNN_EVENT_BEGIN_ARRAY = 2,
+    JSNN_EVENT_END_ARRAY = 3,
+    JSNN_EVENT_KEY = 4,
+    JSNN_EVENT_STRING = 5,
+    JSNN_EVENT_PRIMITIVE = 6
+} jsnnevent_t;
+
+/**
+ * Receives one event. [start, end) is the byte range in the current
+ * buffer (strings exclude their quotes; brackets are one byte), depth the
+ * number of enclosing objects/arrays. Return nonzero to stop parsing.
+ */
+typedef int (*jsnn_event_cb)(jsnnevent_t event, jsnnint_t start,
+        jsnnint_t end, int depth, void *data);
+
+/**
+ * Event-driven parser state. Nothing is materialized, so memory is
+ * bounded by JSNN_MAX_DEPTH no matter how large the document is.
+ */
+typedef struct {
+	jsnnuint_t pos; /* bytes of the current buffer fully consumed */
+	int depth;
+	int stopped; /* a callback asked to stop */
+	int final; /* the buffer ends the input */
+	jsnnpair_t pairtype;
+	unsigned char open[JSNN_MAX_DEPTH]; /* JSNN_OBJECT or JSNN_ARRAY */
+} jsnn_sax;
+
+void jsnn_sax_init(jsnn_sax *parser);
+
+/**
+ * Parse len bytes of js, reporting events to cb. Returns JSNN_SUCCESS when
+ * the buffer ends with every object and array closed, JSNN_ERROR_PART when
+ * more input is expected, JSNN_ERROR_INVAL on malformed input and
+ * JSNN_ERROR_NOMEM when nesting exceeds JSNN_MAX_DEPTH.
+ *
+ * Documents can be fed in chunks: a string or primitive cut off by the end
+ * of the buffer is left unconsumed, so move bytes [pos, len) to the front,
+ * append more input, reset pos to 0 and call again. Since a top-level
+ * primitive ending the buffer may still go on, it is held back too and
+ * only reported by jsnn_sax_finish.
+ */
+jsnnerr_t jsnn_sax_parse(jsnn_sax *parser, const char *js, jsnnuint_t len,
+        jsnn_event_cb cb, void *data);
+
+/**
+ * Parse the last bytes of the input, as jsnn_sax_parse does, except that
+ * the end of the buffer also ends a primitive.
+ */
+jsnnerr_t jsnn_sax_finish(jsnn_sax *parser, const char *js, jsnnuint_t len,
+        jsnn_event_cb cb, void *data);
 
 /**
  * Extract a value from the tokens returned by the parser based on a javascript-style
- * attribute/index access syntax.
+ * attribute/index access syntax. With wildcards, returns the first match.
  *
  * @param   path    Path to json node (e.g. "states[2].counties[10].name")
  */
 jsnntok_t *jsnn_get(jsnntok_t *root, const char *path,
         const char *json, jsnntok_t *tokens);
 
+/**
+ * Compile a path once for repeated use with jsnn_select. Returns
+ * JSNN_ERROR_INVAL on a malformed path and JSNN_ERROR_NOMEM if it has
+ * more than JSNN_MAX_STEPS steps.
+ */
+jsnnerr_t jsnn_compile(jsnn_path *compiled, const char *path);
+
+/**
+ * Collect every token matching a compiled path, in document order, in a
+ * single traversal below root. At most max_out matches are stored in out;
+ * the total number of matches is returned.
+ */
+jsnnint_t jsnn_select(jsnntok_t *root, const jsnn_path *path,
+        const char *json, jsnntok_t *tokens, jsnntok_t **out, jsnnint_t max_out);
+
+/**
+ * Like jsnn_select, but streams matches to a callback.
+ */
+jsnnint_t jsnn_select_each(jsnntok_t *root, const jsnn_path *path,
+        const char *json, jsnntok_t *tokens, jsnn_select_cb cb, void *data);
+
+/**
+ * Return the first token matching a compiled path, stopping the traversal
+ * there, or NULL if nothing matches.
+ */
+jsnntok_t *jsnn_select_first(jsnntok_t *root, const jsnn_path *path,
+        const char *json, jsnntok_t *tokens);
+
+/**
+ * Compile and select in one call (e.g. "dogs[*].name" or "..breed").
+ * Returns the number of matches, or a negative jsnnerr_t if the path is
+ * malformed.
+ */
+jsnnint_t jsnn_query(jsnntok_t *root, const char *path,
+        const char *json, jsnntok_t *tokens, jsnntok_t **out, jsnnint_t max_out);
+
+/**
+ * Initialize a key intern table over num_entries slots (at least one).
+ * Only the largest power of two not above num_entries is used, and at
+ * most half of those slots can hold keys.
+ */
+void jsnn_intern_init(jsnn_intern *table, jsnn_intern_entry *entries,
+        unsigned int num_entries);
+
+/**
+ * Register a key and return its id. Ids are assigned in order starting at
+ * 0; adding a known key returns its existing id. The key bytes are not
+ * copied and must outlive the table. Returns JSNN_ERROR_NOMEM when full.
+ */
+int jsnn_intern_add(jsnn_intern *table, const char *key, int len);
+
+/**
+ * Look up the id of a key, or -1 if it is unknown.
+ */
+int jsnn_intern_find(const jsnn_intern *table, const char *key, int len);
+
+/**
+ * Like a single-attribute jsnn_get, but matches the object's keys by
+ * interned id instead of comparing bytes. Requires parser.intern to have
+ * been set when the tokens were parsed.
+ */
+jsnntok_t *jsnn_get_key(jsnntok_t *obj, int key, jsnntok_t *tokens);
+
+/**
+ * Target types for struct binding.
+ * 	o Int: int64_t
+ * 	o Double: double
+ * 	o Bool: int (0 or 1)
+ * 	o String: jsnn_str view of the raw (still escaped) string bytes
+ * 	o Object: nested struct described by its own field table
+ * 	o Array: fixed-capacity C array plus an int element count
+ */
+typedef enum {
+    JSNN_BIND_INT = 0,
+    JSNN_BIND_DOUBLE = 1,
+    JSNN_BIND_BOOL = 2,
+    JSNN_BIND_STRING = 3,
+    JSNN_BIND_OBJECT = 4,
+    JSNN_BIND_ARRAY = 5
+} jsnnbind_t;
+
+typedef struct {
+    const char *ptr;
+    jsnnint_t len;
+} jsnn_str;
+
+/**
+ * Maps one key of a JSON object to a field of a C struct.
+ * @param       name        key in the JSON object
+ * @param       type        type of the struct field
+ * @param       offset      offset of the field in the struct
+ * @param       fields      object: nested field table; array: element
+ *                          descriptor (its name and offset are ignored)
+ * @param       num_fields  object: entries in fields; array: capacity
+ * @param       stride      array: size of one element
+ * @param       count       array: offset of the int receiving the count
+ */
+typedef struct jsnn_bind {
+    const char *name;
+    jsnnbind_t type;
+    size_t offset;
+    const struct jsnn_bind *fields;
+    int num_fields;
+    size_t stride;
+    size_t count;
+} jsnn_bind;
+
+#define JSNN_NELEM(a) (sizeof(a) / sizeof((a)[0]))
+
+/**
+ * Field table helpers. For example:
+ *
+ *     static const jsnn_bind dog_fields[] = {
+ *         JSNN_BIND_FIELD(struct dog, name, JSNN_BIND_STRING),
+ *         JSNN_BIND_FIELD(struct dog, age, JSNN_BIND_INT)
+ *     };
+ */
+#define JSNN_BIND_FIELD(st, member, type) \
+    { #member, type, offsetof(st, member), NULL, 0, 0, 0 }
+
+#define JSNN_BIND_STRUCT(st, member, table) \
+    { #member, JSNN_BIND_OBJECT, offsetof(st, member), \
+      table, JSNN_NELEM(table), 0, 0 }
+
+#define JSNN_BIND_ARRAY_OF(st, member, count_member, elem) \
+    { #member, JSNN_BIND_ARRAY, offsetof(st, member), &(elem), \
+      JSNN_NELEM(((st *)0)->member), sizeof(((st *)0)->member[0]), \
+      offsetof(st, count_member) }
+
+/**
+ * Fill a C struct from an object token in a single pass over its members.
+ * Keys without a descriptor, and null values, are skipped and leave the
+ * field untouched. Array elements beyond the capacity are ignored (the
+ * count still reflects how many were stored). Returns JSNN_ERROR_INVAL
+ * if a value does not match its field's type.
+ */
+jsnnerr_t jsnn_bind_struct(jsnntok_t *obj, const char *js,
+        const jsnn_bind *fields, int num_fields, void *out);
+
+/**
+ * Called when a writer's buffer is full, and by jsnn_write_finish.
+ * Return nonzero to report an error.
+ */
+typedef int (*jsnn_flush_cb)(const char *buf, jsnnuint_t len, void *data);
+
+/**
+ * Streaming JSON writer. Output goes into a caller-provided buffer; with
+ * a flush callback the buffer is only staging and may be small, without
+ * one the whole document must fit. Errors are sticky: once a call fails,
+ * every later call returns the same error.
+ */
+typedef struct {
+    char *buf;
+    jsnnuint_t cap;
+    jsnnuint_t len; /* bytes pending in buf */
+    jsnnuint_t total; /* bytes produced so far */
+    jsnn_flush_cb flush;
+    void *data;
+    int depth;
+    int after_key;
+    int done; /* a root value has been started */
+    unsigned char open[JSNN_MAX_DEPTH]; /* JSNN_OBJECT or JSNN_ARRAY */
+    unsigned char empty[JSNN_MAX_DEPTH];
+    jsnnerr_t err;
+} jsnn_writer;
+
+void jsnn_writer_init(jsnn_writer *w, char *buf, jsnnuint_t cap,
+        jsnn_flush_cb flush, void *data);
+
+/**
+ * Emit structure and values. Commas and colons are inserted as needed.
+ * Strings are escaped from raw bytes of length len. Return
+ * JSNN_ERROR_NOMEM when the buffer is full and there is no flush
+ * callback, and JSNN_ERROR_INVAL on misuse (a key outside an object, a
+ * value where a key is expected, a second top-level value, nesting beyond
+ * JSNN_MAX_DEPTH, or a non-finite double).
+ */
+jsnnerr_t jsnn_write_begin_object(jsnn_writer *w);
+jsnnerr_t jsnn_write_end_object(jsnn_writer *w);
+jsnnerr_t jsnn_write_begin_array(jsnn_writer *w);
+jsnnerr_t jsnn_write_end_array(jsnn_writer *w);
+jsnnerr_t jsnn_write_key(jsnn_writer *w, const char *s, jsnnint_t len);
+jsnnerr_t jsnn_write_string(jsnn_writer *w, const char *s, jsnnint_t len);
+jsnnerr_t jsnn_write_int(jsnn_writer *w, int64_t v);
+jsnnerr_t jsnn_write_double(jsnn_writer *w, double v);
+jsnnerr_t jsnn_write_bool(jsnn_writer *w, int v);
+jsnnerr_t jsnn_write_null(jsnn_writer *w);
+
+/**
+ * Check that every object and array was closed and hand any pending bytes
+ * to the flush callback. Without a callback the output is NUL-terminated
+ * when there is room; its length is w->total.
+ */
+jsnnerr_t jsnn_write_finish(jsnn_writer *w);
+
 /**
  * Compare a null-terminated string with the string pointed to by
  * the given token. Returns 0 if equal, <0 if token string is less
@@ -92,4 +471,169 @@ jsnntok_t *jsnn_get(jsnntok_t *root, const char *path,
  */
 int jsnn_cmp(jsnntok_t *token, const char *json, const char *s);
 
+/**
+ * Copy tokens into out in breadth-first order: every container's children
+ * are contiguous (keys directly followed by their values) and the
+ * container's key field points at the first of them, so lookups step
+ * through members without skipping subtrees and array indexing is direct.
+ * Parents are renumbered; out must hold num_tokens tokens and must not
+ * overlap tokens.
+ *
+ * jsnn_get, jsnn_select, jsnn_select_each, jsnn_query and jsnn_get_key
+ * return the same tokens in either order. Everything else that walks
+ * tokens (patching, re-parsing, binding, hashing, diffing, jsnn_dom_build
+ * and jsnn.hpp) needs document order. Fails with JSNN_ERROR_NOMEM past
+ * INT_MAX tokens.
+ */
+jsnnerr_t jsnn_relayout(jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnntok_t *out);
+
+/**
+ * Patch operation kinds for jsnn_patch.
+ * 	o Replace: substitute the bytes of a token (strings include their quotes)
+ * 	o Insert: add a member to an object or an element to an array
+ * 	o Delete: remove an object member or array element, with its comma
+ */
+typedef enum {
+    JSNN_PATCH_REPLACE = 0,
+    JSNN_PATCH_INSERT = 1,
+    JSNN_PATCH_DELETE = 2
+} jsnnpatchop_t;
+
+/**
+ * A single edit applied by jsnn_patch.
+ * @param       op          replace, insert or delete
+ * @param       target      token to replace/delete, or container to insert into
+ * @param       index       insert position among the container's members
+ *                          (-1 appends)
+ * @param       key         object insert only: key bytes, without quotes
+ * @param       key_len     length of key
+ * @param       bytes       replacement/inserted value, emitted verbatim
+ * @param       len         length of bytes
+ */
+typedef struct {
+    jsnnpatchop_t op;
+    jsnntok_t *target;
+    int index;
+    const char *key;
+    int key_len;
+    const char *bytes;
+    jsnnint_t len;
+} jsnnpatch_t;
+
+/**
+ * Produce a patched copy of a parsed document without re-serializing it.
+ * Unchanged byte ranges between edits are copied straight from js. Each
+ * insert or delete also walks the tokens of its container once, to find
+ * its member.
+ *
+ * Deleting a name token deletes the whole member. Commas are placed so the
+ * result stays valid JSON, however inserts and deletes combine. Edits must
+ * not overlap; overlapping edits fail with JSNN_ERROR_INVAL, and more than
+ * JSNN_MAX_EDITS edits fail with JSNN_ERROR_NOMEM. Like snprintf, at most
+ * out_len bytes are written (out may be NULL to measure) and the full
+ * patched length is returned; the output is NUL-terminated when it fits.
+ *
+ * @param   num_tokens  Number of parsed tokens (parser.toknext)
+ */
+jsnnint_t jsnn_patch(const char *js, jsnntok_t *tokens, jsnnuint_t num_tokens,
+        const jsnnpatch_t *edits, unsigned int num_edits,
+        char *out, jsnnuint_t out_len);
+
+/**
+ * 128-bit structural hash of a token's subtree; lo alone serves as a
+ * 64-bit hash.
+ */
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} jsnnhash_t;
+
+/**
+ * Hash every token's subtree in one pass, into hashes[i] for tokens[i].
+ * Hashes ignore whitespace and the order of object members, so equal
+ * hashes mean equal values, however they were written. Strings and
+ * primitives are hashed as written: "\u0041" and "A", or 1 and 1.0,
+ * differ. Returns JSNN_ERROR_NOMEM if nesting exceeds JSNN_MAX_DEPTH.
+ *
+ * @param   num_tokens  Number of parsed tokens (parser.toknext)
+ */
+jsnnerr_t jsnn_hash(const char *js, jsnntok_t *tokens, jsnnint_t num_tokens,
+        jsnnhash_t *hashes);
+
+/**
+ * Differences reported by jsnn_diff.
+ */
+typedef enum {
+    JSNN_DIFF_CHANGED = 0,
+    JSNN_DIFF_ADDED = 1,
+    JSNN_DIFF_REMOVED = 2
+} jsnndiff_t;
+
+/**
+ * Receives one difference at path (in jsnn_get syntax, "" for the root),
+ * with the tokens on either side; a is NULL for additions and b for
+ * removals. Return nonzero to stop.
+ */
+typedef int (*jsnn_diff_cb)(jsnndiff_t kind, const char *path,
+        jsnntok_t *a, jsnntok_t *b, void *data);
+
+/**
+ * Report the paths at which the first value of document b differs from
+ * that of document a, given both documents' jsnn_hash results. Subtrees
+ * with equal hashes are not compared any further, though stepping past
+ * one still walks its tokens. Object members are matched by key: when
+ * both sides keep them in the same order each lookup is found next, but
+ * reordered members cost a scan of the object per key. Array elements
+ * are matched by index. Keys that jsnn_get could not read back as a bare
+ * name are reported quoted, as in "['a.b']".
+ *
+ * Returns JSNN_ERROR_NOMEM if a path is longer than JSNN_MAX_PATH.
+ */
+jsnnerr_t jsnn_diff(const char *js_a, jsnntok_t *tokens_a,
+        const jsnnhash_t *hashes_a,
+        const char *js_b, jsnntok_t *tokens_b, const jsnnhash_t *hashes_b,
+        jsnn_diff_cb cb, void *data);
+
+/**
+ * Running aggregates of the values found by jsnn_scan. Nulls are not
+ * counted; sum, min and max cover numbers only. Distinct strings and
+ * primitives are estimated with a HyperLogLog sketch of
+ * 2^JSNN_AGG_BITS registers (about 3% error at the default of 10).
+ */
+typedef struct {
+    uint64_t records; /* top-level values scanned */
+    uint64_t count; /* values found at the path */
+    uint64_t numbers; /* of which numbers */
+    double sum;
+    double min;
+    double max;
+    unsigned char registers[1 << JSNN_AGG_BITS];
+} jsnn_agg;
+
+void jsnn_agg_init(jsnn_agg *agg);
+
+/**
+ * Estimated number of distinct values seen.
+ */
+double jsnn_agg_distinct(const jsnn_agg *agg);
+
+/**
+ * Scan every top-level value in js (e.g. the lines of NDJSON), adding the
+ * values at path to agg. No tokens are produced: subtrees off the path are
+ * skipped by bracket counting, and only the path's own steps are
+ * followed, so memory use is constant. Paths may use keys, indices and
+ * "*"; descent and filters fail with JSNN_ERROR_INVAL.
+ *
+ * Returns JSNN_ERROR_INVAL on malformed input (skipped subtrees are only
+ * checked for balance) and JSNN_ERROR_PART if js ends inside a value.
+ * Values of records scanned before the error stay in agg.
+ */
+jsnnerr_t jsnn_scan(const char *js, jsnnuint_t len, const jsnn_path *path,
+        jsnn_agg *agg);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* __JSNN_H_ */
@@ -0,0 +1,264 @@
+#ifndef __JSNN_HPP_
+#define __JSNN_HPP_
+
+/**
+ * Header-only C++17 layer over jsnn. A document parses a JSON string
+ * (owned or borrowed) into tokens; values are cheap views into it.
+ *
+ *     jsnn::document<> doc(json);
+ *     if (doc.parse() != JSNN_SUCCESS) ...
+ *     std::string_view breed = doc.get<"dogs"_k, 1, "breed"_k>().str();
+ *     for (jsnn::value dog : doc.root()["dogs"])
+ *         ...
+ *
+ * Paths given as template arguments are resolved at compile time into a
+ * sequence of direct key/index lookups, so no path string is parsed at
+ * run time. The "_k" literal relies on the string literal operator
+ * template extension supported by GCC and Clang.
+ */
+
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "jsnn.h"
+
+namespace jsnn {
+
+/**
+ * Storage for compile-time keys; "name"_k yields a pointer to str, whose
+ * array type also carries the key length.
+ */
+template <typename C, C... cs>
+struct key_str {
+    static constexpr char str[] = {cs..., '\0'};
+};
+
+namespace literals {
+
+template <typename C, C... cs>
+constexpr auto operator""_k() {
+    return &key_str<C, cs...>::str;
+}
+
+} // namespace literals
+
+/**
+ * A view of one token. A default-constructed or failed-lookup value is
+ * empty and tests false; lookups on an empty value stay empty.
+ */
+class value {
+public:
+    value() : js_(nullptr), tokens_(nullptr), tok_(nullptr) {}
+    value(const char *js, jsnntok_t *tokens, jsnntok_t *tok)
+        : js_(js), tokens_(tokens), tok_(tok) {}
+
+    explicit operator bool() const { return tok_ != nullptr; }
+    jsnntok_t *token() const { return tok_; }
+
+    jsnntype_t type() const { return tok_->type; }
+    bool is_object() const { return tok_ && tok_->type == JSNN_OBJECT; }
+    bool is_array() const { return tok_ && tok_->type == JSNN_ARRAY; }
+    bool is_string() const { return tok_ && tok_->type == JSNN_STRING; }
+    bool is_null() const {
+        return tok_ && tok_->type == JSNN_PRIMITIVE && js_[tok_->start] == 'n';
+    }
+
+    /** Raw text of the token; for strings, the still-escaped contents. */
+    std::string_view str() const {
+        if (!tok_)
+            return std::string_view();
+        return std::string_view(js_ + tok_->start, tok_->end - tok_->start);
+    }
+
+    /** Key of an object member value, or empty. */
+    std::string_view key() const {
+        if (!tok_ || tok_->parent < 0 || tokens_[tok_->parent].type != JSNN_OBJECT)
+            return std::string_view();
+        return value(js_, tokens_, tok_ - 1).str();
+    }
+
+    int64_t as_int64(int64_t fallback = 0) const {
+        if (!tok_ || tok_->type != JSNN_PRIMITIVE)
+            return fallback;
+        return std::strtoll(js_ + tok_->start, nullptr, 10);
+    }
+
+    double as_double(double fallback = 0) const {
+        if (!tok_ || tok_->type != JSNN_PRIMITIVE)
+            return fallback;
+        return std::strtod(js_ + tok_->start, nullptr);
+    }
+
+    bool as_bool(bool fallback = false) const {
+        if (!tok_ || tok_->type != JSNN_PRIMITIVE)
+            return fallback;
+        return js_[tok_->start] == 't';
+    }
+
+    /** Number of members (objects) or elements (arrays). */
+    jsnnint_t size() const {
+        if (!tok_)
+            return 0;
+        return tok_->type == JSNN_OBJECT ? tok_->size / 2 : tok_->size;
+    }
+
+    value operator[](std::string_view key) const {
+        if (!is_object())
+            return value();
+        jsnntok_t *k = tok_ + 1;
+        for (jsnnint_t n = tok_->size / 2; n > 0; n--) {
+            if (value(js_, tokens_, k).str() == key)
+                return value(js_, tokens_, k + 1);
+            k = skip(k + 1);
+        }
+        return value();
+    }
+
+    value operator[](jsnnint_t index) const {
+        if (!is_array() || index < 0 || index >= tok_->size)
+            return value();
+        jsnntok_t *t = tok_ + 1;
+        for (; index > 0; index--)
+            t = skip(t);
+        return value(js_, tokens_, t);
+    }
+
+    /** Runtime path lookup, as jsnn_get. */
+    value get(const char *path) const {
+        if (!tok_)
+            return value();
+        return value(js_, tokens_, jsnn_get(tok_, path, js_, tokens_));
+    }
+
+    /** Compile-time path lookup: get<"dogs"_k, 1, "breed"_k>(). */
+    template <auto... Steps>
+    value get() const {
+        value v = *this;
+        ((v = v.step<Steps>()), ...);
+        return v;
+    }
+
+    /** Iterates over array elements or object member values. */
+    class iterator {
+    public:
+        iterator(const char *js, jsnntok_t *tokens, jsnntok_t *tok,
+                jsnnint_t left, bool object)
+            : js_(js), tokens_(tokens), tok_(tok), left_(left), object_(object) {}
+
+        value operator*() const {
+            return value(js_, tokens_, object_ ? tok_ + 1 : tok_);
+        }
+        iterator &operator++() {
+            tok_ = skip(object_ ? tok_ + 1 : tok_);
+            left_--;
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return left_ != other.left_; }
+        bool operator==(const iterator &other) const { return left_ == other.left_; }
+
+    private:
+        const char *js_;
+        jsnntok_t *tokens_;
+        jsnntok_t *tok_;
+        jsnnint_t left_;
+        bool object_;
+    };
+
+    iterator begin() const {
+        bool container = is_object() || is_array();
+        return iterator(js_, tokens_, container ? tok_ + 1 : nullptr,
+                container ? size() : 0, is_object());
+    }
+    iterator end() const {
+        return iterator(js_, tokens_, nullptr, 0, is_object());
+    }
+
+private:
+    /** Token after the subtree at t; sizes count direct children. */
+    static jsnntok_t *skip(jsnntok_t *t) {
+        for (jsnnint_t remaining = 1; remaining > 0; t++)
+            remaining += t->size - 1;
+        return t;
+    }
+
+    template <auto Step>
+    value step() const {
+        if constexpr (std::is_integral_v<decltype(Step)>) {
+            return (*this)[static_cast<jsnnint_t>(Step)];
+        } else {
+            using array = std::remove_pointer_t<decltype(Step)>;
+            return (*this)[std::string_view(*Step, std::extent_v<array> - 1)];
+        }
+    }
+
+    const char *js_;
+    jsnntok_t *tokens_;
+    jsnntok_t *tok_;
+};
+
+/**
+ * A parsed document. With Capacity > 0 the tokens live inline (handy on
+ * the stack for small documents) and parsing fails with JSNN_ERROR_NOMEM
+ * past that many; with the default of 0 they live in a vector that grows
+ * as needed.
+ *
+ * Constructed from a const char * the JSON is borrowed and must outlive
+ * the document; constructed from a std::string it is owned.
+ */
+template <std::size_t Capacity = 0>
+class document {
+public:
+    explicit document(const char *js) : borrowed_(js) {}
+    explicit document(std::string js) : owned_(std::move(js)), borrowed_(nullptr) {}
+
+    const char *json() const { return borrowed_ ? borrowed_ : owned_.c_str(); }
+
+    jsnnerr_t parse() {
+        jsnn_init(&parser_);
+        if constexpr (Capacity > 0) {
+            return jsnn_parse(&parser_, json(), tokens_.data(), Capacity);
+        } else {
+            if (tokens_.empty())
+                tokens_.resize(64);
+            for (;;) {
+                jsnnerr_t r = jsnn_parse(&parser_, json(), tokens_.data(),
+                        tokens_.size());
+                if (r != JSNN_ERROR_NOMEM)
+                    return r;
+                /* The parser resumes where it ran out of tokens */
+                tokens_.resize(tokens_.size() * 2);
+            }
+        }
+    }
+
+    jsnnint_t num_tokens() const { return parser_.toknext; }
+    jsnntok_t *tokens() { return tokens_.data(); }
+
+    value root() {
+        if (parser_.toknext == 0)
+            return value();
+        return value(json(), tokens_.data(), tokens_.data());
+    }
+
+    value get(const char *path) { return root().get(path); }
+
+    template <auto... Steps>
+    value get() { return root().template get<Steps...>(); }
+
+private:
+    using storage = std::conditional_t<(Capacity > 0),
+          std::array<jsnntok_t, Capacity>, std::vector<jsnntok_t>>;
+
+    std::string owned_;
+    const char *borrowed_;
+    jsnn_parser parser_ = {};
+    storage tokens_ = {};
+};
+
+} // namespace jsnn
+
+#endif /* __JSNN_HPP_ */
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "jsnn_batch.h"
+
+/**
+ * A worker's share of the documents. next is advanced atomically, by the
+ * owner and by thieves alike, one chunk at a time.
+ */
+typedef struct {
+    jsnnuint_t next;
+    jsnnuint_t end;
+} jsnn_share;
+
+typedef struct {
+    const jsnn_input *inputs;
+    const jsnn_path *paths;
+    int num_paths;
+    jsnntok_t **columns;
+    jsnnerr_t *status;
+    jsnn_share *shares;
+    jsnnerr_t err;
+} jsnn_batch;
+
+typedef struct {
+    jsnn_pool *pool;
+    int id;
+    jsnntok_t *tokens;
+    jsnnuint_t num_tokens;
+} jsnn_worker;
+
+struct jsnn_pool {
+    pthread_t *threads;
+    jsnn_worker *workers;
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    unsigned long generation;
+    int running;
+    int quit;
+    jsnn_batch *batch;
+};
+
+/**
+ * Parse one document into the worker's arena, doubling it whenever the
+ * parser runs out of tokens (the parser resumes where it stopped).
+ */
+static
+jsnnerr_t jsnn_batch_parse(jsnn_worker *w, const jsnn_input *in) {
+    jsnn_parser parser;
+    jsnntok_t *grown;
+    jsnnerr_t r;
+
+    jsnn_init(&parser);
+    for (;;) {
+        r = jsnn_parse_len(&parser, in->js, in->len, w->tokens, w->num_tokens);
+        if (r != JSNN_ERROR_NOMEM)
+            break;
+        grown = realloc(w->tokens, 2 * w->num_tokens * sizeof(jsnntok_t));
+        if (grown == NULL)
+            return JSNN_ERROR_NOMEM;
+        w->tokens = grown;
+        w->num_tokens *= 2;
+    }
+    if (r == JSNN_SUCCESS && parser.toknext == 0)
+        r = JSNN_ERROR_PART;
+    return r;
+}
+
+static
+void jsnn_batch_doc(jsnn_worker *w, jsnn_batch *b, jsnnuint_t d) {
+    jsnntok_t *match, *out;
+    jsnnerr_t r;
+    int p;
+
+    r = jsnn_batch_parse(w, &b->inputs[d]);
+    if (b->status != NULL)
+        b->status[d] = r;
+    if (r == JSNN_ERROR_NOMEM)
+        __atomic_store_n(&b->err, r, __ATOMIC_RELAXED);
+    for (p = 0; p < b->num_paths; p++) {
+        match = NULL;
+        if (r == JSNN_SUCCESS)
+            match = jsnn_select_first(w->tokens, &b->paths[p],
+                    b->inputs[d].js, w->tokens);
+        out = &b->columns[p][d];
+        if (match != NULL) {
+            *out = *match;
+        } else {
+            memset(out, 0, sizeof(*out));
+            out->start = out->end = -1;
+            out->key = -1;
+        }
+        out->parent = -1;
+    }
+}
+
+/**
+ * Drain the worker's own share, then steal from the others in turn.
+ */
+static
+void jsnn_batch_work(jsnn_worker *w, jsnn_batch *b) {
+    jsnn_share *share;
+    jsnnuint_t d, end;
+    int i, n = w->pool->num_threads;
+
+    for (i = 0; i < n; i++) {
+        share = &b->shares[(w->id + i) % n];
+        for (;;) {
+            d = __atomic_fetch_add(&share->next, JSNN_BATCH_CHUNK,
+                    __ATOMIC_RELAXED);
+            if (d >= share->end)
+                break;
+            end = d + JSNN_BATCH_CHUNK < share->end ? d + JSNN_BATCH_CHUNK
+                : share->end;
+            for (; d < end; d++)
+                jsnn_batch_doc(w, b, d);
+        }
+    }
+}
+
+static
+void *jsnn_pool_main(void *arg) {
+    jsnn_worker *w = arg;
+    jsnn_pool *pool = w->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        jsnn_batch_work(w, pool->batch);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0)
+            pthread_cond_signal(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+jsnn_pool *jsnn_pool_create(int num_threads) {
+    jsnn_pool *pool;
+    int i;
+
+    if (num_threads < 1)
+        return NULL;
+    if ((pool = calloc(1, sizeof(*pool))) == NULL)
+        return NULL;
+    pool->threads = calloc(num_threads, sizeof(pthread_t));
+    pool->workers = calloc(num_threads, sizeof(jsnn_worker));
+    if (pool->threads == NULL || pool->workers == NULL) {
+        free(pool->threads);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (i = 0; i < num_threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->workers[i].num_tokens = 256;
+        pool->workers[i].tokens = malloc(256 * sizeof(jsnntok_t));
+        if (pool->workers[i].tokens == NULL
+                || pthread_create(&pool->threads[i], NULL, jsnn_pool_main,
+                    &pool->workers[i]) != 0) {
+            free(pool->workers[i].tokens);
+            pool->workers[i].tokens = NULL;
+            break;
+        }
+        pool->num_threads++;
+    }
+    if (pool->num_threads < num_threads) {
+        jsnn_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void jsnn_pool_destroy(jsnn_pool *pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+        free(pool->workers[i].tokens);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool);
+}
+
+jsnnerr_t jsnn_batch_query(jsnn_pool *pool,
+        const jsnn_input *inputs, jsnnuint_t num_inputs,
+        const jsnn_path *paths, int num_paths,
+        jsnntok_t **columns, jsnnerr_t *status) {
+    jsnn_batch batch;
+    jsnnuint_t per;
+    int i, n = pool->num_threads;
+
+    batch.inputs = inputs;
+    batch.paths = paths;
+    batch.num_paths = num_paths;
+    batch.columns = columns;
+    batch.status = status;
+    batch.err = JSNN_SUCCESS;
+    if ((batch.shares = malloc(n * sizeof(jsnn_share))) == NULL)
+        return JSNN_ERROR_NOMEM;
+
+    /* Split the inputs evenly; stealing evens out uneven documents */
+    per = (num_inputs + n - 1) / n;
+    for (i = 0; i < n; i++) {
+        batch.shares[i].next = per * i < num_inputs ? per * i : num_inputs;
+        batch.shares[i].end = per * (i + 1) < num_inputs ? per * (i + 1)
+            : num_inputs;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->batch = &batch;
+    pool->running = n;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    while (pool->running > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pool->batch = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    free(batch.shares);
+    return batch.err;
+}
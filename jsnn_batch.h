@@ -0,0 +1,61 @@
+#ifndef __JSNN_BATCH_H_
+#define __JSNN_BATCH_H_
+
+#include "jsnn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JSNN_BATCH_CHUNK
+    #define JSNN_BATCH_CHUNK 64
+#endif
+
+/**
+ * One document of a batch. js need not be NUL-terminated.
+ */
+typedef struct {
+    const char *js;
+    jsnnuint_t len;
+} jsnn_input;
+
+/**
+ * A pool of worker threads, each with its own reusable token arena.
+ */
+typedef struct jsnn_pool jsnn_pool;
+
+/**
+ * Start a pool of num_threads workers. Returns NULL if the threads or
+ * their arenas could not be created.
+ */
+jsnn_pool *jsnn_pool_create(int num_threads);
+
+/**
+ * Stop the workers and free the pool. It must not be running a batch.
+ */
+void jsnn_pool_destroy(jsnn_pool *pool);
+
+/**
+ * Parse every input and run every compiled path over it, spread over the
+ * pool's workers. Documents are handed out in chunks of JSNN_BATCH_CHUNK;
+ * a worker that runs out of its own share steals chunks from the others.
+ *
+ * Results are column-oriented: columns[p][d] receives a copy of the first
+ * token matching paths[p] in inputs[d], with offsets relative to
+ * inputs[d].js, or a token with start and end of -1 if nothing matched.
+ * If status is not NULL, status[d] receives the parse result of document
+ * d; documents that fail to parse match nothing.
+ *
+ * Only one batch may run on a pool at a time. Returns JSNN_ERROR_NOMEM if
+ * a worker could not grow its token arena.
+ */
+jsnnerr_t jsnn_batch_query(jsnn_pool *pool,
+        const jsnn_input *inputs, jsnnuint_t num_inputs,
+        const jsnn_path *paths, int num_paths,
+        jsnntok_t **columns, jsnnerr_t *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSNN_BATCH_H_ */
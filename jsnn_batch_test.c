@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsnn_batch.h"
+
+static int test_passed = 0;
+static int test_failed = 0;
+
+/* Terminate current test with error */
+#define fail()	return __LINE__
+
+/* Check single condition */
+#define check(cond) do { if (!(cond)) fail(); } while (0)
+
+/* Test runner */
+static void test(int (*func)(void), const char *name) {
+	int r = func();
+	if (r == 0) {
+		test_passed++;
+	} else {
+		test_failed++;
+		printf("FAILED: %s (at line %d)\n", name, r);
+	}
+}
+
+#define NUM_DOCS 1000
+
+int test_batch() {
+	static char bufs[NUM_DOCS][1024], many[801];
+	static jsnn_input inputs[NUM_DOCS];
+	static jsnntok_t ids[NUM_DOCS], names[NUM_DOCS], tags[NUM_DOCS];
+	static jsnnerr_t status[NUM_DOCS];
+	jsnntok_t *columns[3];
+	jsnn_path paths[3];
+	jsnn_pool *pool;
+	int i, n;
+
+	for (i = 0; i < 400; i++) {
+		many[2 * i] = '1';
+		many[2 * i + 1] = ',';
+	}
+	many[799] = '\0';
+
+	for (i = 0; i < NUM_DOCS; i++) {
+		if (i == 500) {
+			n = sprintf(bufs[i], "{\"id\": 500, \"name\": ");
+		} else {
+			/* Every 7th document is large enough to grow the arenas */
+			n = sprintf(bufs[i], "{\"id\": %d, \"name\": \"n%d\", \"tags\": [%s]}",
+					i, i, i % 7 ? "1" : many);
+		}
+		inputs[i].js = bufs[i];
+		/* Documents need not be NUL-terminated */
+		bufs[i][n] = '#';
+		inputs[i].len = n;
+	}
+
+	check(jsnn_compile(&paths[0], "id") == JSNN_SUCCESS);
+	check(jsnn_compile(&paths[1], "name") == JSNN_SUCCESS);
+	check(jsnn_compile(&paths[2], "tags[*]") == JSNN_SUCCESS);
+	columns[0] = ids;
+	columns[1] = names;
+	columns[2] = tags;
+
+	pool = jsnn_pool_create(4);
+	check(pool != NULL);
+	check(jsnn_batch_query(pool, inputs, NUM_DOCS, paths, 3, columns, status)
+			== JSNN_SUCCESS);
+
+	for (i = 0; i < NUM_DOCS; i++) {
+		if (i == 500) {
+			check(status[i] == JSNN_ERROR_PART);
+			check(ids[i].start == -1 && names[i].start == -1);
+			continue;
+		}
+		check(status[i] == JSNN_SUCCESS);
+		check(atoi(bufs[i] + ids[i].start) == i);
+		check(ids[i].type == JSNN_PRIMITIVE);
+		check(names[i].type == JSNN_STRING && atoi(bufs[i] + names[i].start + 1) == i);
+		check(bufs[i][tags[i].start] == '1');
+	}
+
+	/* The pool is reusable */
+	check(jsnn_batch_query(pool, inputs, 10, paths, 1, columns, NULL)
+			== JSNN_SUCCESS);
+	check(atoi(bufs[9] + ids[9].start) == 9);
+	jsnn_pool_destroy(pool);
+	return 0;
+}
+
+int main() {
+	test(test_batch, "test batch queries over a thread pool");
+	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
+	return 0;
+}
@@ -0,0 +1,352 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsnn_dom.h"
+
+#define JSNN_DOM_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/**
+ * Nodes are bumped up from the start of the arena and strings from the
+ * end of the node region, which is sized exactly beforehand.
+ */
+typedef struct {
+    const char *js;
+    jsnntok_t *tokens;
+    char *nodes;
+    char *strings;
+    jsnnerr_t err;
+} jsnn_dom_builder;
+
+void jsnn_arena_init(jsnn_arena *arena) {
+    arena->buf = NULL;
+    arena->cap = 0;
+    arena->used = 0;
+}
+
+void jsnn_arena_free(jsnn_arena *arena) {
+    free(arena->buf);
+    jsnn_arena_init(arena);
+}
+
+static
+int jsnn_dom_hex(const char *s) {
+    int i, v = 0;
+    char c;
+
+    for (i = 0; i < 4; i++) {
+        c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return v;
+}
+
+/**
+ * Unescape len bytes of a JSON string into out, which the result never
+ * outgrows (a \uXXXX escape makes at most three bytes of UTF-8, a
+ * surrogate pair four). Lone surrogates become U+FFFD. Returns the
+ * decoded length, or -1 for a bad escape.
+ */
+static
+jsnnint_t jsnn_dom_unescape(const char *s, jsnnint_t len, char *out) {
+    const char *end = s + len;
+    char *o = out;
+    long cp;
+    int lo;
+
+    while (s < end) {
+        if (*s != '\\') {
+            *o++ = *s++;
+            continue;
+        }
+        if (++s == end)
+            return -1;
+        switch (*s++) {
+            case '"': *o++ = '"'; break;
+            case '\\': *o++ = '\\'; break;
+            case '/': *o++ = '/'; break;
+            case 'b': *o++ = '\b'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'n': *o++ = '\n'; break;
+            case 'r': *o++ = '\r'; break;
+            case 't': *o++ = '\t'; break;
+            case 'u':
+                if (end - s < 4 || (cp = jsnn_dom_hex(s)) < 0)
+                    return -1;
+                s += 4;
+                if (cp >= 0xd800 && cp <= 0xdbff && end - s >= 6 && s[0] == '\\'
+                        && s[1] == 'u' && (lo = jsnn_dom_hex(s + 2)) >= 0xdc00
+                        && lo <= 0xdfff) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    s += 6;
+                } else if (cp >= 0xd800 && cp <= 0xdfff) {
+                    cp = 0xfffd;
+                }
+                if (cp < 0x80) {
+                    *o++ = (char)cp;
+                } else if (cp < 0x800) {
+                    *o++ = (char)(0xc0 | cp >> 6);
+                    *o++ = (char)(0x80 | (cp & 0x3f));
+                } else if (cp < 0x10000) {
+                    *o++ = (char)(0xe0 | cp >> 12);
+                    *o++ = (char)(0x80 | (cp >> 6 & 0x3f));
+                    *o++ = (char)(0x80 | (cp & 0x3f));
+                } else {
+                    *o++ = (char)(0xf0 | cp >> 18);
+                    *o++ = (char)(0x80 | (cp >> 12 & 0x3f));
+                    *o++ = (char)(0x80 | (cp >> 6 & 0x3f));
+                    *o++ = (char)(0x80 | (cp & 0x3f));
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    *o = '\0';
+    return o - out;
+}
+
+static
+const char *jsnn_dom_string(jsnn_dom_builder *b, jsnntok_t *t, jsnnint_t *len) {
+    char *out = b->strings;
+
+    *len = jsnn_dom_unescape(b->js + t->start, t->end - t->start, out);
+    if (*len < 0) {
+        b->err = JSNN_ERROR_INVAL;
+        return NULL;
+    }
+    b->strings += *len + 1;
+    return out;
+}
+
+/**
+ * Check s against the JSON number grammar, which strtod is far laxer
+ * than (it takes "nan", "inf" and hex). Returns 1 for an integer, 2 for
+ * a number with a fraction or exponent and 0 for anything else.
+ */
+static
+int jsnn_dom_number(const char *s, jsnnint_t len) {
+    const char *end = s + len;
+    int kind = 1;
+
+    if (s < end && *s == '-')
+        s++;
+    if (s < end && *s == '0') {
+        s++;
+    } else {
+        if (s == end || *s < '1' || *s > '9')
+            return 0;
+        while (s < end && *s >= '0' && *s <= '9')
+            s++;
+    }
+    if (s < end && *s == '.') {
+        if (++s == end || *s < '0' || *s > '9')
+            return 0;
+        while (s < end && *s >= '0' && *s <= '9')
+            s++;
+        kind = 2;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        s++;
+        if (s < end && (*s == '+' || *s == '-'))
+            s++;
+        if (s == end || *s < '0' || *s > '9')
+            return 0;
+        while (s < end && *s >= '0' && *s <= '9')
+            s++;
+        kind = 2;
+    }
+    return s == end ? kind : 0;
+}
+
+static
+jsnnerr_t jsnn_dom_primitive(const char *s, jsnnint_t len, jsnn_node *node) {
+    char num[128], *end;
+    int kind;
+
+    if (len == 4 && memcmp(s, "null", 4) == 0) {
+        node->type = JSNN_DOM_NULL;
+        return JSNN_SUCCESS;
+    }
+    if ((len == 4 && memcmp(s, "true", 4) == 0)
+            || (len == 5 && memcmp(s, "false", 5) == 0)) {
+        node->type = JSNN_DOM_BOOL;
+        node->u.boolean = s[0] == 't';
+        return JSNN_SUCCESS;
+    }
+    kind = jsnn_dom_number(s, len);
+    if (kind == 0 || len >= (jsnnint_t)sizeof(num))
+        return JSNN_ERROR_INVAL;
+    /* Tokens are not NUL-terminated */
+    memcpy(num, s, len);
+    num[len] = '\0';
+    errno = 0;
+    if (kind == 1) {
+        node->u.integer = strtoll(num, &end, 10);
+        if (errno == 0) {
+            node->type = JSNN_DOM_INT;
+            return JSNN_SUCCESS;
+        }
+        /* Integers past int64_t fall back to double */
+        errno = 0;
+    }
+    node->u.number = strtod(num, &end);
+    if (errno == ERANGE)
+        return JSNN_ERROR_INVAL;
+    node->type = JSNN_DOM_DOUBLE;
+    return JSNN_SUCCESS;
+}
+
+static
+int jsnn_dom_cmp(const char *a, jsnnint_t alen, const char *b, jsnnint_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0)
+        return c;
+    return alen < blen ? -1 : alen > blen;
+}
+
+static
+int jsnn_dom_member_cmp(const void *a, const void *b) {
+    const jsnn_member *ma = a, *mb = b;
+    return jsnn_dom_cmp(ma->key, ma->key_len, mb->key, mb->key_len);
+}
+
+/**
+ * Build the value at token i into node; returns the index after its
+ * subtree, or -1 with b->err set.
+ */
+static
+jsnnint_t jsnn_dom_value(jsnn_dom_builder *b, jsnnint_t i, jsnn_node *node,
+        int depth) {
+    jsnntok_t *t = &b->tokens[i];
+    jsnn_member *m;
+    jsnnint_t j, n;
+
+    node->len = 0;
+    switch (t->type) {
+        case JSNN_OBJECT:
+        case JSNN_ARRAY:
+            if (depth == JSNN_MAX_DEPTH) {
+                b->err = JSNN_ERROR_NOMEM;
+                return -1;
+            }
+            j = i + 1;
+            if (t->type == JSNN_ARRAY) {
+                node->type = JSNN_DOM_ARRAY;
+                node->len = t->size;
+                node->u.elements = (jsnn_node *)b->nodes;
+                b->nodes += JSNN_DOM_ALIGN(t->size * sizeof(jsnn_node));
+                for (n = 0; n < t->size; n++) {
+                    j = jsnn_dom_value(b, j, &node->u.elements[n], depth + 1);
+                    if (j < 0)
+                        return -1;
+                }
+                return j;
+            }
+            node->type = JSNN_DOM_OBJECT;
+            node->len = t->size / 2;
+            node->u.members = m = (jsnn_member *)b->nodes;
+            b->nodes += JSNN_DOM_ALIGN(node->len * sizeof(jsnn_member));
+            for (n = 0; n < node->len; n++) {
+                m[n].key = jsnn_dom_string(b, &b->tokens[j], &m[n].key_len);
+                if (m[n].key == NULL)
+                    return -1;
+                j = jsnn_dom_value(b, j + 1, &m[n].value, depth + 1);
+                if (j < 0)
+                    return -1;
+            }
+            if (node->len > 1)
+                qsort(m, node->len, sizeof(*m), jsnn_dom_member_cmp);
+            return j;
+        case JSNN_STRING:
+            node->type = JSNN_DOM_STRING;
+            node->u.string = jsnn_dom_string(b, t, &node->len);
+            return node->u.string != NULL ? i + 1 : -1;
+        default:
+            b->err = jsnn_dom_primitive(b->js + t->start, t->end - t->start, node);
+            return b->err == JSNN_SUCCESS ? i + 1 : -1;
+    }
+}
+
+jsnnerr_t jsnn_dom_build(jsnn_arena *arena, const char *js,
+        jsnntok_t *tokens, jsnnint_t num_tokens, jsnn_node **root) {
+    jsnn_dom_builder b;
+    size_t nodes = JSNN_DOM_ALIGN(sizeof(jsnn_node)), strings = 0, need;
+    jsnnint_t i;
+    char *buf;
+
+    if (num_tokens <= 0)
+        return JSNN_ERROR_INVAL;
+
+    /* Containers get a node (or member) per child; every string or
+     * primitive may be a key or string needing a NUL-terminated copy */
+    for (i = 0; i < num_tokens; i++) {
+        if (i > 0 && tokens[i].parent == -1)
+            break;
+        if (tokens[i].type == JSNN_ARRAY)
+            nodes += JSNN_DOM_ALIGN(tokens[i].size * sizeof(jsnn_node));
+        else if (tokens[i].type == JSNN_OBJECT)
+            nodes += JSNN_DOM_ALIGN(tokens[i].size / 2 * sizeof(jsnn_member));
+        else
+            strings += tokens[i].end - tokens[i].start + 1;
+    }
+    need = nodes + strings;
+    if (need > arena->cap) {
+        buf = malloc(need);
+        if (buf == NULL)
+            return JSNN_ERROR_NOMEM;
+        free(arena->buf);
+        arena->buf = buf;
+        arena->cap = need;
+    }
+    arena->used = need;
+
+    b.js = js;
+    b.tokens = tokens;
+    b.nodes = arena->buf;
+    b.strings = arena->buf + nodes;
+    b.err = JSNN_SUCCESS;
+    *root = (jsnn_node *)b.nodes;
+    b.nodes += JSNN_DOM_ALIGN(sizeof(jsnn_node));
+    if (jsnn_dom_value(&b, 0, *root, 0) < 0) {
+        *root = NULL;
+        return b.err;
+    }
+    return JSNN_SUCCESS;
+}
+
+jsnn_node *jsnn_dom_at(const jsnn_node *array, jsnnint_t index) {
+    if (array == NULL || array->type != JSNN_DOM_ARRAY
+            || index < 0 || index >= array->len)
+        return NULL;
+    return &array->u.elements[index];
+}
+
+jsnn_node *jsnn_dom_get(const jsnn_node *object, const char *key,
+        jsnnint_t len) {
+    jsnnint_t lo = 0, hi, mid;
+    int c;
+
+    if (object == NULL || object->type != JSNN_DOM_OBJECT)
+        return NULL;
+    for (hi = object->len; lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+        c = jsnn_dom_cmp(object->u.members[mid].key,
+                object->u.members[mid].key_len, key, len);
+        if (c == 0)
+            return &object->u.members[mid].value;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
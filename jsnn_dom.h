@@ -0,0 +1,101 @@
+#ifndef __JSNN_DOM_H_
+#define __JSNN_DOM_H_
+
+#include "jsnn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Types of DOM nodes. Numbers that are integers within int64_t range
+ * become JSNN_DOM_INT, others JSNN_DOM_DOUBLE.
+ */
+typedef enum {
+    JSNN_DOM_NULL = 0,
+    JSNN_DOM_BOOL = 1,
+    JSNN_DOM_INT = 2,
+    JSNN_DOM_DOUBLE = 3,
+    JSNN_DOM_STRING = 4,
+    JSNN_DOM_ARRAY = 5,
+    JSNN_DOM_OBJECT = 6
+} jsnndomtype_t;
+
+struct jsnn_member;
+
+/**
+ * A decoded value.
+ * @param       len     bytes of a string (not counting its NUL), elements
+ *                      of an array or members of an object
+ */
+typedef struct jsnn_node {
+    jsnndomtype_t type;
+    jsnnint_t len;
+    union {
+        int boolean;
+        int64_t integer;
+        double number;
+        const char *string; /* unescaped UTF-8, NUL-terminated */
+        struct jsnn_node *elements;
+        struct jsnn_member *members; /* sorted by key */
+    } u;
+} jsnn_node;
+
+typedef struct jsnn_member {
+    const char *key; /* unescaped, NUL-terminated */
+    jsnnint_t key_len;
+    jsnn_node value;
+} jsnn_member;
+
+/**
+ * Memory for one DOM at a time. Building into an arena discards the DOM
+ * it held before and keeps its buffer, so a reused arena stops
+ * allocating once it has grown to fit the largest document.
+ */
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t used;
+} jsnn_arena;
+
+void jsnn_arena_init(jsnn_arena *arena);
+
+/**
+ * Free the arena and every node built into it.
+ */
+void jsnn_arena_free(jsnn_arena *arena);
+
+/**
+ * Build a DOM of the first value in tokens, which must be in document
+ * order (not reordered by jsnn_relayout), with all of its nodes and
+ * strings in arena. The exact size is measured first, so the arena is
+ * allocated at most once per build and never per node. Strings and keys
+ * are unescaped, numbers parsed and object members sorted by key.
+ *
+ * Returns JSNN_ERROR_INVAL for bad escapes, for primitives that are not
+ * JSON literals or numbers, and for numbers out of the range of double
+ * (ERANGE from strtod). Returns JSNN_ERROR_NOMEM if memory runs out or
+ * nesting exceeds JSNN_MAX_DEPTH.
+ *
+ * @param   num_tokens  Number of parsed tokens (parser.toknext)
+ */
+jsnnerr_t jsnn_dom_build(jsnn_arena *arena, const char *js,
+        jsnntok_t *tokens, jsnnint_t num_tokens, jsnn_node **root);
+
+/**
+ * Element index of an array, in constant time, or NULL.
+ */
+jsnn_node *jsnn_dom_at(const jsnn_node *array, jsnnint_t index);
+
+/**
+ * Member of an object by its unescaped key, by binary search, or NULL.
+ * Of duplicate keys, any one may be found.
+ */
+jsnn_node *jsnn_dom_get(const jsnn_node *object, const char *key,
+        jsnnint_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSNN_DOM_H_ */
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jsnn_dom.h"
+
+static int test_passed = 0;
+static int test_failed = 0;
+
+/* Terminate current test with error */
+#define fail()	return __LINE__
+
+/* Check single condition */
+#define check(cond) do { if (!(cond)) fail(); } while (0)
+
+/* Test runner */
+static void test(int (*func)(void), const char *name) {
+	int r = func();
+	if (r == 0) {
+		test_passed++;
+	} else {
+		test_failed++;
+		printf("FAILED: %s (at line %d)\n", name, r);
+	}
+}
+
+int test_dom() {
+	const char *js = "{\"name\": \"r\\u00e9x \\\"the\\\" dog\\n\", \"age\": 7, "
+		"\"weight\": 12.5, \"big\": 123456789012345678901, \"good\": true, "
+		"\"owner\": null, \"tags\": [\"a\", [1, 2], {}], \"emoji\": \"\\ud83d\\ude00\", "
+		"\"b\": false, \"a\": -3}";
+	jsnntok_t tokens[64];
+	jsnn_parser p;
+	jsnn_arena arena;
+	const char *bad[] = { "[1, tru]", "[nan]", "[inf]", "[0x10]", "[1e999]",
+		"[01]", "[1.]", "[+1]" };
+	jsnn_node *root, *n;
+	size_t cap;
+	int i;
+
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 64) == JSNN_SUCCESS);
+	jsnn_arena_init(&arena);
+	check(jsnn_dom_build(&arena, js, tokens, p.toknext, &root) == JSNN_SUCCESS);
+	check(root->type == JSNN_DOM_OBJECT && root->len == 10);
+
+	/* Members are sorted by key */
+	check(strcmp(root->u.members[0].key, "a") == 0);
+	check(strcmp(root->u.members[1].key, "age") == 0);
+	check(strcmp(root->u.members[9].key, "weight") == 0);
+
+	n = jsnn_dom_get(root, "name", 4);
+	check(n != NULL && n->type == JSNN_DOM_STRING);
+	check(strcmp(n->u.string, "r\xc3\xa9x \"the\" dog\n") == 0 && n->len == 15);
+	n = jsnn_dom_get(root, "emoji", 5);
+	check(n != NULL && strcmp(n->u.string, "\xf0\x9f\x98\x80") == 0);
+	n = jsnn_dom_get(root, "age", 3);
+	check(n != NULL && n->type == JSNN_DOM_INT && n->u.integer == 7);
+	n = jsnn_dom_get(root, "a", 1);
+	check(n != NULL && n->type == JSNN_DOM_INT && n->u.integer == -3);
+	n = jsnn_dom_get(root, "weight", 6);
+	check(n != NULL && n->type == JSNN_DOM_DOUBLE && n->u.number == 12.5);
+	n = jsnn_dom_get(root, "big", 3);
+	check(n != NULL && n->type == JSNN_DOM_DOUBLE && n->u.number > 1.2e20);
+	n = jsnn_dom_get(root, "good", 4);
+	check(n != NULL && n->type == JSNN_DOM_BOOL && n->u.boolean == 1);
+	n = jsnn_dom_get(root, "owner", 5);
+	check(n != NULL && n->type == JSNN_DOM_NULL);
+	check(jsnn_dom_get(root, "nope", 4) == NULL);
+	check(jsnn_dom_get(root, "ag", 2) == NULL);
+
+	n = jsnn_dom_get(root, "tags", 4);
+	check(n != NULL && n->type == JSNN_DOM_ARRAY && n->len == 3);
+	check(jsnn_dom_at(n, 0)->type == JSNN_DOM_STRING);
+	check(jsnn_dom_at(jsnn_dom_at(n, 1), 1)->u.integer == 2);
+	check(jsnn_dom_at(n, 2)->type == JSNN_DOM_OBJECT && jsnn_dom_at(n, 2)->len == 0);
+	check(jsnn_dom_at(n, 3) == NULL && jsnn_dom_at(n, -1) == NULL);
+
+	/* A reused arena keeps its buffer for smaller documents */
+	cap = arena.cap;
+	js = "[1, \"two\", 3.0]";
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 64) == JSNN_SUCCESS);
+	check(jsnn_dom_build(&arena, js, tokens, p.toknext, &root) == JSNN_SUCCESS);
+	check(arena.cap == cap && root->len == 3);
+	check(strcmp(jsnn_dom_at(root, 1)->u.string, "two") == 0);
+
+	/* The parser lets primitives through unchecked, and strtod would
+	 * take several that are not JSON numbers */
+	for (i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++) {
+		js = bad[i];
+		jsnn_init(&p);
+		check(jsnn_parse(&p, js, tokens, 64) == JSNN_SUCCESS);
+		check(jsnn_dom_build(&arena, js, tokens, p.toknext, &root)
+				== JSNN_ERROR_INVAL);
+		check(root == NULL);
+	}
+	js = "[-0, 0.5e-3, 1E+2]";
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 64) == JSNN_SUCCESS);
+	check(jsnn_dom_build(&arena, js, tokens, p.toknext, &root) == JSNN_SUCCESS);
+	check(jsnn_dom_at(root, 0)->type == JSNN_DOM_INT);
+	check(jsnn_dom_at(root, 1)->u.number == 0.5e-3);
+	check(jsnn_dom_at(root, 2)->u.number == 100);
+
+	jsnn_arena_free(&arena);
+	check(arena.buf == NULL);
+	return 0;
+}
+
+int main() {
+	test(test_dom, "test building a DOM in an arena");
+	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
+	return 0;
+}
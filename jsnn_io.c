@@ -0,0 +1,328 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "jsnn_io.h"
+
+/**
+ * The document is mapped over an anonymous reservation one padding longer
+ * than the file. Bytes of the file's last page past its end read as zero;
+ * the whole pages after it come from the reservation, so they are zero
+ * too rather than faulting with SIGBUS.
+ */
+jsnn_doc *jsnn_doc_open(const char *path) {
+    jsnn_doc *doc;
+    struct stat st;
+    size_t page, file_len;
+    char *map;
+    int fd, err;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0)
+        goto fail_fd;
+    /* Token offsets are jsnnint_t, so the length must fit one (build with
+     * JSNN_LARGE past 2 GB), and the mapping size_t once padded and
+     * rounded to pages */
+    page = (size_t)sysconf(_SC_PAGESIZE);
+    if ((uintmax_t)st.st_size > (uintmax_t)((jsnnuint_t)-1 >> 1)
+            || (uintmax_t)st.st_size > SIZE_MAX - JSNN_DOC_PADDING - page) {
+        errno = EOVERFLOW;
+        goto fail_fd;
+    }
+    doc = malloc(sizeof(*doc));
+    if (doc == NULL)
+        goto fail_fd;
+
+    file_len = ((size_t)st.st_size + page - 1) / page * page;
+    doc->len = (jsnnuint_t)st.st_size;
+    doc->map_len = ((size_t)st.st_size + JSNN_DOC_PADDING + page - 1)
+        / page * page;
+    map = mmap(NULL, doc->map_len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+            -1, 0);
+    if (map == MAP_FAILED)
+        goto fail_doc;
+    if (file_len > 0) {
+        if (mmap(map, file_len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+                == MAP_FAILED) {
+            err = errno;
+            munmap(map, doc->map_len);
+            errno = err;
+            goto fail_doc;
+        }
+        /* Hints only; failures are harmless */
+        madvise(map, file_len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(map, file_len, MADV_HUGEPAGE);
+#endif
+    }
+    close(fd);
+    doc->map = map;
+    doc->js = map;
+    return doc;
+
+fail_doc:
+    err = errno;
+    free(doc);
+    errno = err;
+fail_fd:
+    err = errno;
+    close(fd);
+    errno = err;
+    return NULL;
+}
+
+void jsnn_doc_close(jsnn_doc *doc) {
+    if (doc == NULL)
+        return;
+    munmap(doc->map, doc->map_len);
+    free(doc);
+}
+
+/**
+ * A block buffer: block_size bytes of headroom, where bytes carried over
+ * from the previous block are copied, followed by block_size bytes read.
+ */
+typedef struct {
+    char *buf;
+    size_t len; /* bytes read; 0 at end of input */
+    int err; /* errno of a failed read */
+    int full; /* read and not yet released by the consumer */
+} jsnn_slot;
+
+struct jsnn_reader {
+    int fd;
+    size_t block_size;
+    jsnnread_t mode;
+    jsnn_slot slots[2];
+    int next; /* slot the consumer takes next */
+    int cur; /* slot holding the current block, or -1 for merge */
+    const char *js; /* current block */
+    jsnnuint_t len; /* bytes of it handed out */
+    jsnnuint_t carry; /* bytes after those, in records mode */
+    char *merge; /* joins carries too large for the headroom */
+    size_t merge_cap;
+    int done;
+    int quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/**
+ * Fill the slots in turn until end of input or a read error, each of
+ * which is posted as a slot of its own.
+ */
+static
+void *jsnn_reader_run(void *arg) {
+    jsnn_reader *r = arg;
+    jsnn_slot *s;
+    size_t n;
+    ssize_t got;
+    int fill, quit, err;
+
+    for (fill = 0; ; fill ^= 1) {
+        s = &r->slots[fill];
+        pthread_mutex_lock(&r->lock);
+        while (s->full && !r->quit)
+            pthread_cond_wait(&r->cond, &r->lock);
+        quit = r->quit;
+        pthread_mutex_unlock(&r->lock);
+        if (quit)
+            break;
+
+        for (n = 0, err = 0; n < r->block_size; n += got) {
+            got = read(r->fd, s->buf + r->block_size + n, r->block_size - n);
+            if (got < 0 && errno == EINTR) {
+                got = 0;
+                continue;
+            }
+            if (got <= 0) {
+                if (got < 0)
+                    err = errno;
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&r->lock);
+        s->len = n;
+        s->err = err;
+        s->full = 1;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        if (n == 0 || err)
+            break;
+    }
+    return NULL;
+}
+
+static
+jsnn_slot *jsnn_reader_wait(jsnn_reader *r, int i) {
+    pthread_mutex_lock(&r->lock);
+    while (!r->slots[i].full)
+        pthread_cond_wait(&r->cond, &r->lock);
+    pthread_mutex_unlock(&r->lock);
+    return &r->slots[i];
+}
+
+static
+void jsnn_reader_release(jsnn_reader *r, int i) {
+    if (i < 0)
+        return;
+    pthread_mutex_lock(&r->lock);
+    r->slots[i].full = 0;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+jsnn_reader *jsnn_reader_open(int fd, size_t block_size, jsnnread_t mode) {
+    jsnn_reader *r;
+    int i, err;
+
+    if (block_size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return NULL;
+    r->fd = fd;
+    r->block_size = block_size;
+    r->mode = mode;
+    r->cur = -1;
+    r->js = "";
+    for (i = 0; i < 2; i++) {
+        r->slots[i].buf = malloc(2 * block_size);
+        if (r->slots[i].buf == NULL)
+            goto fail;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    err = pthread_create(&r->thread, NULL, jsnn_reader_run, r);
+    if (err != 0) {
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        errno = err;
+        goto fail;
+    }
+    return r;
+
+fail:
+    err = errno;
+    free(r->slots[0].buf);
+    free(r->slots[1].buf);
+    free(r);
+    errno = err;
+    return NULL;
+}
+
+int jsnn_reader_next(jsnn_reader *r, jsnnuint_t keep,
+        const char **js, jsnnuint_t *len) {
+    const char *carry;
+    jsnn_slot *s;
+    char *dst, *grown;
+    size_t n;
+    jsnnuint_t i;
+
+    if (r->done)
+        return 0;
+    if (r->mode == JSNN_READ_RECORDS) {
+        keep = r->carry;
+        carry = r->js + r->len;
+    } else {
+        if (keep > r->len) {
+            errno = EINVAL;
+            return -1;
+        }
+        carry = r->js + r->len - keep;
+    }
+
+    for (;;) {
+        s = jsnn_reader_wait(r, r->next);
+        if (s->err) {
+            errno = s->err;
+            return -1;
+        }
+        n = s->len;
+        if (n == 0) {
+            r->done = 1;
+            if (r->mode != JSNN_READ_RECORDS || keep == 0)
+                return 0;
+            /* A last line with no newline */
+            *js = carry;
+            *len = keep;
+            return 1;
+        }
+
+        if (keep <= r->block_size) {
+            /* The usual case: the carry fits in the headroom */
+            dst = s->buf + r->block_size - keep;
+            if (keep > 0)
+                memcpy(dst, carry, keep);
+            jsnn_reader_release(r, r->cur);
+            r->cur = r->next;
+        } else {
+            if (r->cur < 0)
+                memmove(r->merge, carry, keep);
+            if (keep + n > r->merge_cap) {
+                grown = realloc(r->merge, keep + n);
+                if (grown == NULL) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+                r->merge = grown;
+                r->merge_cap = keep + n;
+            }
+            if (r->cur >= 0)
+                memcpy(r->merge, carry, keep);
+            memcpy(r->merge + keep, s->buf + r->block_size, n);
+            jsnn_reader_release(r, r->cur);
+            jsnn_reader_release(r, r->next);
+            r->cur = -1;
+            dst = r->merge;
+        }
+        r->next ^= 1;
+        r->js = dst;
+        keep += n;
+
+        if (r->mode == JSNN_READ_CHUNKS) {
+            r->len = keep;
+            break;
+        }
+        for (i = keep; i > 0 && dst[i - 1] != '\n'; i--)
+            ;
+        if (i > 0) {
+            r->len = i;
+            r->carry = keep - i;
+            break;
+        }
+        /* No newline yet: the whole block is carried into the next */
+        r->len = 0;
+        carry = dst;
+    }
+    *js = r->js;
+    *len = r->len;
+    return 1;
+}
+
+void jsnn_reader_close(jsnn_reader *r) {
+    if (r == NULL)
+        return;
+    pthread_mutex_lock(&r->lock);
+    r->quit = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r->slots[0].buf);
+    free(r->slots[1].buf);
+    free(r->merge);
+    free(r);
+}
@@ -0,0 +1,94 @@
+#ifndef __JSNN_IO_H_
+#define __JSNN_IO_H_
+
+#include "jsnn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Readable bytes guaranteed past the end of a loaded document, so scanners
+ * that read a word or vector at a time may over-read. They are zero, which
+ * also NUL-terminates the document.
+ */
+#ifndef JSNN_DOC_PADDING
+    #define JSNN_DOC_PADDING 64
+#endif
+
+/**
+ * A read-only, memory-mapped JSON file. js[len] through
+ * js[len + JSNN_DOC_PADDING - 1] are readable zeros.
+ */
+typedef struct {
+    const char *js;
+    jsnnuint_t len;
+    void *map;
+    size_t map_len;
+} jsnn_doc;
+
+/**
+ * Map the file at path and advise the kernel it will be read
+ * sequentially. Returns NULL, with errno set, if the file cannot be
+ * opened or mapped; errno is EOVERFLOW if token offsets (jsnnint_t)
+ * could not reach its end, as happens at 2 GB unless built with
+ * JSNN_LARGE.
+ */
+jsnn_doc *jsnn_doc_open(const char *path);
+
+/**
+ * Unmap the document and free it. Tokens parsed from it become invalid.
+ */
+void jsnn_doc_close(jsnn_doc *doc);
+
+/**
+ * How jsnn_reader_next splits input into blocks.
+ */
+typedef enum {
+    /* Blocks end after a newline; a partial record leads the next block */
+    JSNN_READ_RECORDS = 0,
+    /* Blocks end anywhere; the caller says how much of one it left over */
+    JSNN_READ_CHUNKS = 1
+} jsnnread_t;
+
+/**
+ * Reads a file descriptor a block at a time on a background thread,
+ * double-buffered, so the next block is read while this one is parsed.
+ */
+typedef struct jsnn_reader jsnn_reader;
+
+/**
+ * Start reading fd in blocks of block_size bytes. The descriptor stays
+ * owned by the caller. Returns NULL, with errno set, if the buffers or
+ * thread could not be created.
+ */
+jsnn_reader *jsnn_reader_open(int fd, size_t block_size, jsnnread_t mode);
+
+/**
+ * Hand out the next block in *js and *len, valid until the following call.
+ * Blocks are not NUL-terminated.
+ *
+ * With JSNN_READ_CHUNKS, keep is the number of bytes at the end of the
+ * previous block that were not consumed (e.g. len - pos after
+ * jsnn_sax_parse); they are carried over to the front of the next block.
+ * With JSNN_READ_RECORDS keep is ignored: every block holds whole lines,
+ * growing past block_size if a single line needs it, and a last line with
+ * no newline is handed out on its own.
+ *
+ * Returns 1 for a block, 0 at end of input and -1, with errno set, on a
+ * read or allocation error.
+ */
+int jsnn_reader_next(jsnn_reader *reader, jsnnuint_t keep,
+        const char **js, jsnnuint_t *len);
+
+/**
+ * Stop the background thread, waiting for a read in progress, and free
+ * the reader.
+ */
+void jsnn_reader_close(jsnn_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSNN_IO_H_ */
@@ -0,0 +1,224 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jsnn_io.h"
+
+static int test_passed = 0;
+static int test_failed = 0;
+
+/* Terminate current test with error */
+#define fail()	return __LINE__
+
+/* Check single condition */
+#define check(cond) do { if (!(cond)) fail(); } while (0)
+
+/* Test runner */
+static void test(int (*func)(void), const char *name) {
+	int r = func();
+	if (r == 0) {
+		test_passed++;
+	} else {
+		test_failed++;
+		printf("FAILED: %s (at line %d)\n", name, r);
+	}
+}
+
+/* Write exactly len bytes of JSON: an array of as many ones as fit, with
+ * one space before the closing bracket if needed (a lone 1 if len is 1) */
+static int write_json(const char *path, size_t len) {
+	FILE *fp = fopen(path, "w");
+	size_t left;
+
+	if (fp == NULL)
+		return -1;
+	if (len == 1) {
+		fputc('1', fp);
+	} else if (len > 1) {
+		fputc('[', fp);
+		left = len - 2;
+		if (left > 0) {
+			fputc('1', fp);
+			left--;
+		}
+		for (; left >= 2; left -= 2)
+			fputs(",1", fp);
+		if (left > 0)
+			fputc(' ', fp);
+		fputc(']', fp);
+	}
+	fclose(fp);
+	return 0;
+}
+
+int test_doc() {
+	char path[] = "/tmp/jsnn_io_testXXXXXX";
+	size_t sizes[] = { 0, 1, 7, 4095, 4096, 8192, 100001 };
+	static jsnntok_t tokens[60000];
+	jsnn_parser p;
+	jsnn_doc *doc;
+	size_t i, j;
+	int fd;
+
+	fd = mkstemp(path);
+	check(fd >= 0);
+	close(fd);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		check(write_json(path, sizes[i]) == 0);
+		doc = jsnn_doc_open(path);
+		check(doc != NULL);
+		check(doc->len == sizes[i]);
+		/* Padding is readable and zero even when the file fills its pages */
+		for (j = 0; j < JSNN_DOC_PADDING; j++)
+			check(doc->js[doc->len + j] == '\0');
+		if (sizes[i] >= 7) {
+			jsnn_init(&p);
+			check(jsnn_parse_len(&p, doc->js, doc->len, tokens, 60000)
+					== JSNN_SUCCESS);
+			check(tokens[0].type == JSNN_ARRAY);
+			check(tokens[0].size == (jsnnint_t)(sizes[i] - 1) / 2);
+			check(doc->js[doc->len - 1] == ']');
+		}
+		jsnn_doc_close(doc);
+	}
+
+	/* Up to the largest jsnnint_t offset a file is mapped; past it, it is
+	 * refused rather than parsed with overflowing offsets */
+	check(truncate(path, ((off_t)1 << 31) - 1) == 0);
+	doc = jsnn_doc_open(path);
+	check(doc != NULL && (uint64_t)doc->len == ((uint64_t)1 << 31) - 1);
+	jsnn_doc_close(doc);
+	check(truncate(path, (off_t)1 << 31) == 0);
+	doc = jsnn_doc_open(path);
+	if (sizeof(jsnnint_t) < 8) {
+		check(doc == NULL && errno == EOVERFLOW);
+	} else {
+		check(doc != NULL && (uint64_t)doc->len == (uint64_t)1 << 31);
+		jsnn_doc_close(doc);
+	}
+	unlink(path);
+
+	check(jsnn_doc_open(path) == NULL && errno == ENOENT);
+	return 0;
+}
+
+/* Write a file and open it for reading */
+static int open_with(char *path, const char *text) {
+	FILE *fp;
+	int fd = mkstemp(path);
+
+	if (fd < 0)
+		return -1;
+	close(fd);
+	fp = fopen(path, "w");
+	fputs(text, fp);
+	fclose(fp);
+	fd = open(path, O_RDONLY);
+	unlink(path);
+	return fd;
+}
+
+int test_reader_records() {
+	char path[] = "/tmp/jsnn_io_testXXXXXX";
+	static char text[4096], joined[4096];
+	static jsnntok_t tokens[64];
+	const char *js, *line, *nl;
+	jsnn_reader *r;
+	jsnn_parser p;
+	jsnnuint_t len;
+	int fd, i, records = 0, sum = 0;
+
+	/* Lines shorter and longer than a block, the last without a newline */
+	text[0] = '\0';
+	for (i = 0; i < 40; i++) {
+		sprintf(text + strlen(text), "{\"n\": %d, \"pad\": \"%.*s\"}%s", i,
+				(i * 7) % 50, "..................................................",
+				i < 39 ? "\n" : "");
+	}
+	fd = open_with(path, text);
+	check(fd >= 0);
+	r = jsnn_reader_open(fd, 16, JSNN_READ_RECORDS);
+	check(r != NULL);
+	joined[0] = '\0';
+	while ((i = jsnn_reader_next(r, 0, &js, &len)) == 1) {
+		check(len > 0);
+		check(js[len - 1] == '\n' || strlen(joined) + len == strlen(text));
+		strncat(joined, js, len);
+		for (line = js; line < js + len; line = nl + 1) {
+			nl = memchr(line, '\n', js + len - line);
+			if (nl == NULL)
+				nl = js + len;
+			jsnn_init(&p);
+			check(jsnn_parse_len(&p, line, nl - line, tokens, 64) == JSNN_SUCCESS);
+			sum += atoi(line + tokens[2].start);
+			records++;
+		}
+	}
+	check(i == 0);
+	check(jsnn_reader_next(r, 0, &js, &len) == 0);
+	check(strcmp(joined, text) == 0);
+	check(records == 40 && sum == 39 * 40 / 2);
+	jsnn_reader_close(r);
+	close(fd);
+	return 0;
+}
+
+static int count_events(jsnnevent_t event, jsnnint_t start, jsnnint_t end,
+		int depth, void *data) {
+	int *counts = data;
+	(void)start;
+	(void)end;
+	(void)depth;
+	counts[event]++;
+	return 0;
+}
+
+int test_reader_chunks() {
+	char path[] = "/tmp/jsnn_io_testXXXXXX";
+	static char text[4096];
+	int counts[7] = { 0 };
+	const char *js;
+	jsnn_reader *r;
+	jsnn_sax p;
+	jsnnuint_t len;
+	int fd, i, ret = JSNN_ERROR_PART;
+
+	strcpy(text, "{\"items\": [");
+	for (i = 0; i < 100; i++)
+		sprintf(text + strlen(text), "%s{\"id\": %d, \"name\": \"item %d\"}",
+				i ? ", " : "", i * 1001, i);
+	strcat(text, "]}");
+	fd = open_with(path, text);
+	check(fd >= 0);
+
+	/* Tokens straddle block boundaries; the unconsumed tail is carried */
+	r = jsnn_reader_open(fd, 10, JSNN_READ_CHUNKS);
+	check(r != NULL);
+	jsnn_sax_init(&p);
+	len = 0;
+	while (jsnn_reader_next(r, len - p.pos, &js, &len) == 1) {
+		p.pos = 0;
+		ret = jsnn_sax_parse(&p, js, len, count_events, counts);
+		check(ret == JSNN_SUCCESS || ret == JSNN_ERROR_PART);
+	}
+	check(ret == JSNN_SUCCESS);
+	check(counts[JSNN_EVENT_BEGIN_OBJECT] == 101);
+	check(counts[JSNN_EVENT_KEY] == 201);
+	check(counts[JSNN_EVENT_STRING] == 100);
+	check(counts[JSNN_EVENT_PRIMITIVE] == 100);
+	jsnn_reader_close(r);
+	close(fd);
+	return 0;
+}
+
+int main() {
+	test(test_doc, "test memory-mapped documents");
+	test(test_reader_records, "test reading NDJSON records in blocks");
+	test(test_reader_chunks, "test reading a document in chunks");
+	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
+	return 0;
+}
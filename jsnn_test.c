@@ -40,8 +40,8 @@ static void test(int (*func)(void), const char *name) {
 	 && strlen(s) == (t).end - (t).start)
 
 #define TOKEN_PRINT(t) \
-	printf("start: %d, end: %d, type: %d, size: %d\n", \
-			(t).start, (t).end, (t).type, (t).size)
+	printf("start: %ld, end: %ld, type: %d, size: %ld\n", \
+			(long)(t).start, (long)(t).end, (t).type, (long)(t).size)
 
 int open_json(const char *path) {
     FILE *fp;
@@ -424,6 +424,804 @@ int test_objects_arrays() {
 	return 0;
 }
 
+int test_patch() {
+	int r;
+	jsnn_parser p;
+	jsnntok_t tokens[20];
+	jsnnpatch_t edits[3];
+	char out[64];
+	const char *js;
+
+	js = "{\"a\": 1, \"b\": [1, 2, 3], \"c\": \"x\"}";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 20);
+	check(r == JSNN_SUCCESS);
+
+	memset(edits, 0, sizeof(edits));
+	edits[0].op = JSNN_PATCH_REPLACE;
+	edits[0].target = jsnn_get(tokens, "c", js, tokens);
+	edits[0].bytes = "true";
+	edits[0].len = 4;
+	edits[1].op = JSNN_PATCH_DELETE;
+	edits[1].target = &tokens[6];
+	edits[2].op = JSNN_PATCH_INSERT;
+	edits[2].target = tokens;
+	edits[2].index = 0;
+	edits[2].key = "z";
+	edits[2].key_len = 1;
+	edits[2].bytes = "null";
+	edits[2].len = 4;
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(r == (int)strlen(out));
+	check(strcmp(out, "{\"z\":null,\"a\": 1, \"b\": [1, 3], \"c\": true}") == 0);
+
+	/* Deleting every member must not leave stray commas */
+	memset(edits, 0, sizeof(edits));
+	edits[0].op = JSNN_PATCH_DELETE;
+	edits[0].target = jsnn_get(tokens, "a", js, tokens);
+	edits[1].op = JSNN_PATCH_DELETE;
+	edits[1].target = &tokens[3];
+	edits[2].op = JSNN_PATCH_DELETE;
+	edits[2].target = jsnn_get(tokens, "c", js, tokens);
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(strcmp(out, "{}") == 0);
+
+	edits[1].op = JSNN_PATCH_REPLACE;
+	edits[1].target = &tokens[4];
+	edits[1].bytes = "{}";
+	edits[1].len = 2;
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(strcmp(out, "{\"b\": {}}") == 0);
+
+	/* Measure only */
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, NULL, 0);
+	check(r == 9);
+
+	/* Overlapping edits */
+	edits[2].target = jsnn_get(tokens, "b", js, tokens);
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(r == JSNN_ERROR_INVAL);
+
+	js = "[]";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 20);
+	check(r == JSNN_SUCCESS);
+	memset(edits, 0, sizeof(edits));
+	edits[0].op = JSNN_PATCH_INSERT;
+	edits[0].target = tokens;
+	edits[0].index = -1;
+	edits[0].bytes = "7";
+	edits[0].len = 1;
+	r = jsnn_patch(js, tokens, p.toknext, edits, 1, out, sizeof(out));
+	check(strcmp(out, "[7]") == 0);
+
+	/* An earlier insert at the same spot counts as a predecessor */
+	edits[1] = edits[0];
+	edits[1].bytes = "8";
+	r = jsnn_patch(js, tokens, p.toknext, edits, 2, out, sizeof(out));
+	check(strcmp(out, "[7,8]") == 0);
+
+	/* No comma after an insert when nothing after it survives */
+	js = "[1]";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 20);
+	check(r == JSNN_SUCCESS);
+	edits[0].index = 0;
+	edits[1].op = JSNN_PATCH_DELETE;
+	edits[1].target = &tokens[1];
+	r = jsnn_patch(js, tokens, p.toknext, edits, 2, out, sizeof(out));
+	check(strcmp(out, "[7]") == 0);
+
+	js = "[1, 2, 3]";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 20);
+	check(r == JSNN_SUCCESS);
+	edits[0].index = 1;
+	edits[1].target = &tokens[2];
+	edits[2] = edits[1];
+	edits[2].target = &tokens[3];
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(strcmp(out, "[1, 7]") == 0);
+	edits[0].index = -1;
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(strcmp(out, "[1,7]") == 0);
+	edits[2].target = &tokens[1];
+	r = jsnn_patch(js, tokens, p.toknext, edits, 3, out, sizeof(out));
+	check(strcmp(out, "[3,7]") == 0);
+	return 0;
+}
+
+int test_intern() {
+	int r, i, name, breed;
+	jsnn_parser p;
+	jsnntok_t tokens[20], *token;
+	jsnn_intern table;
+	jsnn_intern_entry entries[12];
+	const char *records[2];
+
+	/* Sizes that are not a power of two are rounded down */
+	jsnn_intern_init(&table, entries, 12);
+	check(table.num_entries == 8);
+	name = jsnn_intern_add(&table, "name", 4);
+	breed = jsnn_intern_add(&table, "breed", 5);
+	check(name == 0 && breed == 1);
+	check(jsnn_intern_add(&table, "name", 4) == name);
+	check(jsnn_intern_find(&table, "breed", 5) == breed);
+	check(jsnn_intern_find(&table, "bree", 4) == -1);
+	check(jsnn_intern_add(&table, "a", 1) == 2);
+	check(jsnn_intern_add(&table, "b", 1) == 3);
+	check(jsnn_intern_add(&table, "c", 1) == JSNN_ERROR_NOMEM);
+
+	records[0] = "{\"name\": \"spot\", \"age\": 3, \"breed\": \"terrier\"}";
+	records[1] = "{\"breed\": \"sphynx\", \"name\": \"pickles\"}";
+	for (i = 0; i < 2; i++) {
+		jsnn_init(&p);
+		p.intern = &table;
+		r = jsnn_parse(&p, records[i], tokens, 20);
+		check(r == JSNN_SUCCESS);
+		token = jsnn_get_key(tokens, breed, tokens);
+		check(token != NULL);
+		check(token == jsnn_get(tokens, "breed", records[i], tokens));
+	}
+	check(tokens[1].key == breed && tokens[3].key == name);
+	check(tokens[2].key == -1 && tokens[4].key == -1);
+
+	/* Unknown keys stay unmatched */
+	jsnn_init(&p);
+	p.intern = &table;
+	r = jsnn_parse(&p, records[0], tokens, 20);
+	check(r == JSNN_SUCCESS);
+	check(tokens[3].key == -1);
+	check(jsnn_get_key(tokens, jsnn_intern_find(&table, "age", 3), tokens) == NULL);
+	return 0;
+}
+
+struct test_owner {
+	jsnn_str name;
+	int64_t id;
+};
+
+struct test_pet {
+	jsnn_str name;
+	int64_t age;
+	double weight;
+	int good;
+	struct test_owner owner;
+	int64_t scores[2];
+	int num_scores;
+};
+
+static const jsnn_bind test_owner_fields[] = {
+	JSNN_BIND_FIELD(struct test_owner, name, JSNN_BIND_STRING),
+	JSNN_BIND_FIELD(struct test_owner, id, JSNN_BIND_INT)
+};
+
+static const jsnn_bind test_score_elem =
+	{ NULL, JSNN_BIND_INT, 0, NULL, 0, 0, 0 };
+
+static const jsnn_bind test_pet_fields[] = {
+	JSNN_BIND_FIELD(struct test_pet, name, JSNN_BIND_STRING),
+	JSNN_BIND_FIELD(struct test_pet, age, JSNN_BIND_INT),
+	JSNN_BIND_FIELD(struct test_pet, weight, JSNN_BIND_DOUBLE),
+	JSNN_BIND_FIELD(struct test_pet, good, JSNN_BIND_BOOL),
+	JSNN_BIND_STRUCT(struct test_pet, owner, test_owner_fields),
+	JSNN_BIND_ARRAY_OF(struct test_pet, scores, num_scores, test_score_elem)
+};
+
+int test_bind() {
+	int r;
+	jsnn_parser p;
+	jsnntok_t tokens[40];
+	struct test_pet pet;
+	const char *js;
+
+	js = "{\"name\": \"gracie\", \"tags\": [{\"x\": 1}, 2], \"age\": -7,"
+		" \"weight\": 31.5, \"good\": true, \"owner\": {\"id\": 42,"
+		" \"name\": \"bob\"}, \"scores\": [3, 1, 4], \"extra\": null}";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 40);
+	check(r == JSNN_SUCCESS);
+
+	memset(&pet, 0, sizeof(pet));
+	r = jsnn_bind_struct(tokens, js, test_pet_fields,
+			JSNN_NELEM(test_pet_fields), &pet);
+	check(r == JSNN_SUCCESS);
+	check(pet.name.len == 6 && strncmp(pet.name.ptr, "gracie", 6) == 0);
+	check(pet.age == -7);
+	check(pet.weight == 31.5);
+	check(pet.good == 1);
+	check(pet.owner.id == 42);
+	check(pet.owner.name.len == 3 && strncmp(pet.owner.name.ptr, "bob", 3) == 0);
+	check(pet.num_scores == 2 && pet.scores[0] == 3 && pet.scores[1] == 1);
+
+	js = "{\"age\": \"old\"}";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 40);
+	check(r == JSNN_SUCCESS);
+	r = jsnn_bind_struct(tokens, js, test_pet_fields,
+			JSNN_NELEM(test_pet_fields), &pet);
+	check(r == JSNN_ERROR_INVAL);
+
+	/* Integers must fit int64_t */
+	js = "{\"age\": -9223372036854775808}";
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 40) == JSNN_SUCCESS);
+	r = jsnn_bind_struct(tokens, js, test_pet_fields,
+			JSNN_NELEM(test_pet_fields), &pet);
+	check(r == JSNN_SUCCESS && pet.age == INT64_MIN);
+	js = "{\"age\": 9223372036854775808}";
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 40) == JSNN_SUCCESS);
+	r = jsnn_bind_struct(tokens, js, test_pet_fields,
+			JSNN_NELEM(test_pet_fields), &pet);
+	check(r == JSNN_ERROR_INVAL);
+	js = "{\"age\": 12345678901234567890}";
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 40) == JSNN_SUCCESS);
+	r = jsnn_bind_struct(tokens, js, test_pet_fields,
+			JSNN_NELEM(test_pet_fields), &pet);
+	check(r == JSNN_ERROR_INVAL);
+	return 0;
+}
+
+static int reparse_matches(const char *before, const char *after,
+		int start, int old_end, int new_end) {
+	jsnn_parser p, full;
+	jsnntok_t tokens[64], expect[64];
+	int r;
+
+	jsnn_init(&p);
+	r = jsnn_parse(&p, before, tokens, 64);
+	if (r != JSNN_SUCCESS) return 0;
+	r = jsnn_reparse(&p, after, tokens, 64, start, old_end, new_end);
+	if (r != JSNN_SUCCESS) return 0;
+
+	jsnn_init(&full);
+	r = jsnn_parse(&full, after, expect, 64);
+	if (r != JSNN_SUCCESS) return 0;
+	if (p.toknext != full.toknext || p.pos != full.pos) return 0;
+	for (r = 0; r < full.toknext; r++) {
+		if (!TOKEN_EQ(tokens[r], expect[r].start, expect[r].end, expect[r].type)
+				|| tokens[r].size != expect[r].size
+				|| tokens[r].parent != expect[r].parent
+				|| tokens[r].pair_type != expect[r].pair_type
+				|| tokens[r].key != expect[r].key)
+			return 0;
+	}
+	return 1;
+}
+
+int test_reparse() {
+	jsnn_parser p;
+	jsnntok_t tokens[64];
+	const char *before;
+
+	before = "{\"a\": [1, 2, {\"b\": \"x\"}], \"c\": {\"d\": 3}, \"e\": 4}";
+
+	/* Value changes length inside a nested object */
+	check(reparse_matches(before,
+		"{\"a\": [1, 2, {\"b\": \"xyz\"}], \"c\": {\"d\": 3}, \"e\": 4}",
+		21, 22, 24));
+	/* Elements added to an array */
+	check(reparse_matches(before,
+		"{\"a\": [1, 2, [5, 6], {\"b\": \"x\"}], \"c\": {\"d\": 3}, \"e\": 4}",
+		13, 13, 21));
+	/* Member removed, shrinking the document */
+	check(reparse_matches(before,
+		"{\"a\": [1, 2, {\"b\": \"x\"}], \"c\": {}, \"e\": 4}",
+		36, 42, 36));
+	/* Edit closes a container early, forcing a full reparse */
+	check(reparse_matches("{\"a\": [1, 2], \"c\": 3}",
+		"{\"a\": [1, 2], \"z\": [0], \"c\": 3}", 11, 11, 21));
+	check(reparse_matches("[1, 2]", "[1, 22]", 5, 5, 6));
+
+	/* Not enough room for the new subtree leaves the tokens intact */
+	jsnn_init(&p);
+	check(jsnn_parse(&p, "[[1], 2]", tokens, 5) == JSNN_SUCCESS);
+	check(jsnn_reparse(&p, "[[1, 5, 6], 2]", tokens, 5, 3, 3, 9)
+			== JSNN_ERROR_NOMEM);
+	check(p.toknext == 4 && tokens[1].size == 1 && tokens[3].start == 6);
+	return 0;
+}
+
+int test_offsets() {
+	int r;
+	jsnn_parser p;
+	jsnntok_t tokens[10];
+	const char *js;
+
+#ifdef JSNN_LARGE
+	check(sizeof(tokens[0].start) == 8 && sizeof(p.pos) == 8);
+	check(sizeof(p.toknext) == 8 && sizeof(tokens[0].parent) == 8);
+#else
+	check(sizeof(tokens[0].start) == sizeof(int));
+#endif
+
+	js = "{\"a\": [1, 2]}";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 10);
+	check(r == JSNN_SUCCESS);
+	check(TOKEN_EQ(tokens[2], 6, 12, JSNN_ARRAY));
+	check(tokens[2].size == 2 && tokens[4].parent == 2);
+	check(jsnn_get(tokens, "a", js, tokens) == &tokens[2]);
+	return 0;
+}
+
+static int count_until_two(jsnntok_t *tok, void *data) {
+	(void)tok;
+	return ++*(int *)data == 2;
+}
+
+int test_query() {
+	int r, n;
+	jsnn_parser p;
+	jsnntok_t tokens[64], *found[8];
+	jsnn_path path;
+	const char *js;
+
+	js = "{\"dogs\": [{\"name\": \"spot\", \"pup\": {\"name\": \"dot\"}},"
+		" {\"name\": \"gracie\"}], \"cats\": [{\"name\": \"pickles\"}]}";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 64);
+	check(r == JSNN_SUCCESS);
+
+	check(jsnn_get(tokens, "dogs[1].name", js, tokens) != NULL);
+	check(jsnn_cmp(jsnn_get(tokens, "dogs[1].name", js, tokens), js, "gracie") == 0);
+	check(jsnn_cmp(jsnn_get(tokens, "['dogs'][0].pup.name", js, tokens), js, "dot") == 0);
+
+	r = jsnn_query(tokens, "dogs[*].name", js, tokens, found, 8);
+	check(r == 2);
+	check(jsnn_cmp(found[0], js, "spot") == 0);
+	check(jsnn_cmp(found[1], js, "gracie") == 0);
+
+	r = jsnn_query(tokens, "..name", js, tokens, found, 8);
+	check(r == 4);
+	check(jsnn_cmp(found[0], js, "spot") == 0);
+	check(jsnn_cmp(found[1], js, "dot") == 0);
+	check(jsnn_cmp(found[2], js, "gracie") == 0);
+	check(jsnn_cmp(found[3], js, "pickles") == 0);
+
+	r = jsnn_query(tokens, ".*[0].name", js, tokens, found, 1);
+	check(r == 2);
+	check(jsnn_cmp(found[0], js, "spot") == 0);
+
+	r = jsnn_query(tokens, "..*", js, tokens, NULL, 0);
+	check(r == 10);
+
+	check(jsnn_compile(&path, "cats..name") == JSNN_SUCCESS);
+	check(path.num_steps == 2 && path.steps[1].kind == JSNN_STEP_DESCEND);
+	check(jsnn_select(tokens, &path, js, tokens, found, 8) == 1);
+
+	n = 0;
+	check(jsnn_compile(&path, "..name") == JSNN_SUCCESS);
+	r = jsnn_select_each(tokens, &path, js, tokens, count_until_two, &n);
+	check(r == 2 && n == 2);
+	check(jsnn_select(tokens, &path, js, tokens, found, 8) >= 1);
+	check(jsnn_select_first(tokens, &path, js, tokens) == found[0]);
+
+	check(jsnn_query(tokens, "dogs[", js, tokens, found, 8) == JSNN_ERROR_INVAL);
+	check(jsnn_query(tokens, "dogs[0]name", js, tokens, found, 8) == JSNN_ERROR_INVAL);
+	check(jsnn_query(tokens, "dogs..", js, tokens, found, 8) == JSNN_ERROR_INVAL);
+	check(jsnn_query(tokens, "", js, tokens, found, 8) == JSNN_ERROR_INVAL);
+	return 0;
+}
+
+int test_filter() {
+	int r;
+	jsnn_parser p;
+	jsnntok_t tokens[64], *found[8];
+	const char *js;
+
+	js = "{\"items\": ["
+		"{\"id\": 1, \"status\": \"active\", \"price\": 9.5},"
+		"{\"id\": 2, \"status\": \"gone\", \"price\": 20},"
+		"{\"id\": 3, \"status\": \"active\", \"price\": 30, \"tags\": [\"x\"]},"
+		"{\"id\": 4, \"ok\": true}]}";
+	jsnn_init(&p);
+	r = jsnn_parse(&p, js, tokens, 64);
+	check(r == JSNN_SUCCESS);
+
+	r = jsnn_query(tokens, "items[?(@.status==\"active\")].id", js, tokens, found, 8);
+	check(r == 2);
+	check(jsnn_cmp(found[0], js, "1") == 0 && jsnn_cmp(found[1], js, "3") == 0);
+
+	r = jsnn_query(tokens, "items[?(@.status == 'active' && @.price > 10)].id",
+			js, tokens, found, 8);
+	check(r == 1 && jsnn_cmp(found[0], js, "3") == 0);
+
+	r = jsnn_query(tokens, "items[?(@.price <= 9.5 || @.id >= 4)].id",
+			js, tokens, found, 8);
+	check(r == 2);
+	check(jsnn_cmp(found[0], js, "1") == 0 && jsnn_cmp(found[1], js, "4") == 0);
+
+	r = jsnn_query(tokens, "items[?(@.tags)].id", js, tokens, found, 8);
+	check(r == 1 && jsnn_cmp(found[0], js, "3") == 0);
+
+	r = jsnn_query(tokens, "items[?(!(@.status) || @.status != 'active')].id",
+			js, tokens, found, 8);
+	check(r == 2);
+	check(jsnn_cmp(found[0], js, "2") == 0 && jsnn_cmp(found[1], js, "4") == 0);
+
+	r = jsnn_query(tokens, "items[?(@.ok == true)].id", js, tokens, found, 8);
+	check(r == 1 && jsnn_cmp(found[0], js, "4") == 0);
+
+	r = jsnn_query(tokens, "items[?(@.tags[0] == 'x')].status", js, tokens, found, 8);
+	check(r == 1 && jsnn_cmp(found[0], js, "active") == 0);
+
+	/* Strings order bytewise, however far apart the first difference is */
+	r = jsnn_query(tokens, "items[?(@.status > 'e')].id", js, tokens, found, 8);
+	check(r == 1 && jsnn_cmp(found[0], js, "2") == 0);
+	r = jsnn_query(tokens, "items[?(@.status <= 'c')].id", js, tokens, found, 8);
+	check(r == 2);
+	check(jsnn_cmp(found[0], js, "1") == 0 && jsnn_cmp(found[1], js, "3") == 0);
+
+	/* Mismatched types never compare */
+	r = jsnn_query(tokens, "items[?(@.id == '1' || @.status > 5)]", js, tokens, found, 8);
+	check(r == 0);
+
+	r = jsnn_query(tokens, "..[?(@.id == 2)]", js, tokens, found, 8);
+	check(r == JSNN_ERROR_INVAL);
+	r = jsnn_query(tokens, "items[?(@.id = 2)]", js, tokens, found, 8);
+	check(r == JSNN_ERROR_INVAL);
+	r = jsnn_query(tokens, "items[?(@.id == 2]", js, tokens, found, 8);
+	check(r == JSNN_ERROR_INVAL);
+	r = jsnn_query(tokens, "items[?(@.id == )]", js, tokens, found, 8);
+	check(r == JSNN_ERROR_INVAL);
+	return 0;
+}
+
+struct test_sink {
+	char buf[256];
+	jsnnuint_t len;
+	int calls;
+};
+
+static int test_flush(const char *buf, jsnnuint_t len, void *data) {
+	struct test_sink *sink = data;
+	if (sink->len + len >= sizeof(sink->buf))
+		return 1;
+	memcpy(sink->buf + sink->len, buf, len);
+	sink->len += len;
+	sink->buf[sink->len] = '\0';
+	sink->calls++;
+	return 0;
+}
+
+static void test_write_doc(jsnn_writer *w) {
+	jsnn_write_begin_object(w);
+	jsnn_write_key(w, "name", 4);
+	jsnn_write_string(w, "say \"hi\"\n\tand a long tail\x01", 26);
+	jsnn_write_key(w, "n", 1);
+	jsnn_write_begin_array(w);
+	jsnn_write_int(w, 0);
+	jsnn_write_int(w, -42);
+	jsnn_write_int(w, INT64_MIN);
+	jsnn_write_double(w, 0.1);
+	jsnn_write_double(w, 1.0 / 3);
+	jsnn_write_double(w, 1e300);
+	jsnn_write_end_array(w);
+	jsnn_write_key(w, "ok", 2);
+	jsnn_write_bool(w, 1);
+	jsnn_write_key(w, "e", 1);
+	jsnn_write_begin_object(w);
+	jsnn_write_end_object(w);
+	jsnn_write_key(w, "z", 1);
+	jsnn_write_null(w);
+	jsnn_write_end_object(w);
+}
+
+int test_writer() {
+	int r;
+	jsnn_writer w;
+	jsnn_parser p;
+	jsnntok_t tokens[32];
+	char out[256], small[7];
+	struct test_sink sink;
+	const char *expect;
+
+	expect = "{\"name\":\"say \\\"hi\\\"\\n\\tand a long tail\\u0001\","
+		"\"n\":[0,-42,-9223372036854775808,0.1,0.3333333333333333,1e+300],"
+		"\"ok\":true,\"e\":{},\"z\":null}";
+
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	test_write_doc(&w);
+	check(jsnn_write_finish(&w) == JSNN_SUCCESS);
+	check(strcmp(out, expect) == 0);
+	check(w.total == strlen(expect));
+
+	jsnn_init(&p);
+	r = jsnn_parse(&p, out, tokens, 32);
+	check(r == JSNN_SUCCESS);
+	check(strtod(out + jsnn_get(tokens, "n[4]", out, tokens)->start, NULL) == 1.0 / 3);
+
+	/* A tiny staging buffer flushed to a sink gives the same bytes */
+	memset(&sink, 0, sizeof(sink));
+	jsnn_writer_init(&w, small, sizeof(small), test_flush, &sink);
+	test_write_doc(&w);
+	check(jsnn_write_finish(&w) == JSNN_SUCCESS);
+	check(strcmp(sink.buf, expect) == 0 && sink.calls > 10);
+
+	/* Out of room without a flush callback */
+	jsnn_writer_init(&w, small, sizeof(small), NULL, NULL);
+	test_write_doc(&w);
+	check(jsnn_write_finish(&w) == JSNN_ERROR_NOMEM);
+
+	/* Misuse */
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	check(jsnn_write_key(&w, "a", 1) == JSNN_ERROR_INVAL);
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	jsnn_write_begin_object(&w);
+	check(jsnn_write_int(&w, 1) == JSNN_ERROR_INVAL);
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	jsnn_write_begin_array(&w);
+	check(jsnn_write_end_object(&w) == JSNN_ERROR_INVAL);
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	jsnn_write_begin_array(&w);
+	check(jsnn_write_double(&w, 1e308 * 10) == JSNN_ERROR_INVAL);
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	jsnn_write_begin_array(&w);
+	check(jsnn_write_finish(&w) == JSNN_ERROR_INVAL);
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	check(jsnn_write_int(&w, 1) == JSNN_SUCCESS);
+	check(jsnn_write_int(&w, 2) == JSNN_ERROR_INVAL);
+	jsnn_writer_init(&w, out, sizeof(out), NULL, NULL);
+	jsnn_write_begin_array(&w);
+	jsnn_write_end_array(&w);
+	check(jsnn_write_begin_object(&w) == JSNN_ERROR_INVAL);
+	return 0;
+}
+
+static char sax_log[512];
+
+static int sax_record(jsnnevent_t event, jsnnint_t start, jsnnint_t end,
+		int depth, void *data) {
+	static const char names[] = "{}[]ksp";
+	size_t n = strlen(sax_log);
+	snprintf(sax_log + n, sizeof(sax_log) - n, "%c%d:%.*s ", names[event],
+			depth, (int)(end - start), (const char *)data + start);
+	return 0;
+}
+
+static int sax_stop(jsnnevent_t event, jsnnint_t start, jsnnint_t end,
+		int depth, void *data) {
+	(void)start;
+	(void)end;
+	(void)depth;
+	(void)data;
+	return event == JSNN_EVENT_KEY;
+}
+
+int test_sax() {
+	const char *js = "{\"a\": [1, \"x\\\"y\", true], \"b\": {\"c\": null}}";
+	const char *expect = "{0:{ k1:a [1:[ p2:1 s2:x\\\"y p2:true ]1:] "
+		"k1:b {1:{ k2:c p2:null }1:} }0:} ";
+	char buf[8];
+	jsnnuint_t len, keep, next;
+	jsnn_sax p;
+	int r;
+
+	sax_log[0] = '\0';
+	jsnn_sax_init(&p);
+	r = jsnn_sax_parse(&p, js, strlen(js), sax_record, (void *)js);
+	check(r == JSNN_SUCCESS);
+	check(strcmp(sax_log, expect) == 0);
+
+	/* Feed through a buffer smaller than several tokens */
+	sax_log[0] = '\0';
+	jsnn_sax_init(&p);
+	for (next = 0, keep = 0; ; keep = len - p.pos) {
+		memmove(buf, buf + p.pos, keep);
+		p.pos = 0;
+		for (len = keep; len < sizeof(buf) && js[next]; len++)
+			buf[len] = js[next++];
+		r = jsnn_sax_parse(&p, buf, len, sax_record, buf);
+		if (r != JSNN_ERROR_PART)
+			break;
+		check(js[next] != '\0');
+	}
+	check(r == JSNN_SUCCESS);
+	check(strcmp(sax_log, expect) == 0);
+
+	js = "[1, 2}";
+	jsnn_sax_init(&p);
+	check(jsnn_sax_parse(&p, js, 6, sax_record, (void *)js) == JSNN_ERROR_INVAL);
+	js = "{\"a\": [1";
+	jsnn_sax_init(&p);
+	check(jsnn_sax_parse(&p, js, 8, sax_record, (void *)js) == JSNN_ERROR_PART);
+	check(p.pos == 7 && p.depth == 2);
+
+	/* A top-level primitive split across chunks waits for the end */
+	sax_log[0] = '\0';
+	jsnn_sax_init(&p);
+	check(jsnn_sax_parse(&p, "6", 1, sax_record, "6") == JSNN_ERROR_PART);
+	check(p.pos == 0 && sax_log[0] == '\0');
+	check(jsnn_sax_finish(&p, "65", 2, sax_record, "65") == JSNN_SUCCESS);
+	js = " nu";
+	jsnn_sax_init(&p);
+	check(jsnn_sax_parse(&p, js, 3, sax_record, (void *)js) == JSNN_ERROR_PART);
+	check(p.pos == 1 && !p.final);
+	p.pos = 0;
+	check(jsnn_sax_finish(&p, "null", 4, sax_record, "null") == JSNN_SUCCESS);
+	check(strcmp(sax_log, "p0:65 p0:null ") == 0);
+
+	jsnn_sax_init(&p);
+	r = jsnn_sax_parse(&p, "{\"a\": 1, \"b\": 2}", 16, sax_stop, NULL);
+	check(r == JSNN_SUCCESS && p.stopped && p.pos == 4);
+	return 0;
+}
+
+static char diff_log[256];
+
+static int diff_record(jsnndiff_t kind, const char *path, jsnntok_t *a,
+		jsnntok_t *b, void *data) {
+	size_t n = strlen(diff_log);
+	(void)a;
+	(void)b;
+	(void)data;
+	snprintf(diff_log + n, sizeof(diff_log) - n, "%c%s ", "~+-"[kind], path);
+	return 0;
+}
+
+int test_hash_diff() {
+	const char *a = "{\"name\": \"rex\", \"tags\": [1, 2, 3], "
+		"\"owner\": {\"id\": 7, \"city\": \"oslo\"}, \"gone\": null}";
+	const char *same = "{\"owner\":{\"city\":\"oslo\",\"id\":7},"
+		"\"gone\":null,\"name\":\"rex\",\"tags\":[1,2,3]}";
+	const char *b = "{\"name\": \"rex\", \"tags\": [1, 5, 3, 4], "
+		"\"owner\": {\"id\": 8, \"city\": \"oslo\"}, \"new\": {}}";
+	jsnntok_t ta[32], tb[32];
+	jsnnhash_t ha[32], hb[32];
+	jsnnint_t na, nb;
+	jsnn_parser p;
+
+	jsnn_init(&p);
+	check(jsnn_parse(&p, a, ta, 32) == JSNN_SUCCESS);
+	na = p.toknext;
+	check(jsnn_hash(a, ta, na, ha) == JSNN_SUCCESS);
+
+	/* Key order and whitespace do not matter */
+	jsnn_init(&p);
+	check(jsnn_parse(&p, same, tb, 32) == JSNN_SUCCESS);
+	nb = p.toknext;
+	check(jsnn_hash(same, tb, nb, hb) == JSNN_SUCCESS);
+	check(ha[0].lo == hb[0].lo && ha[0].hi == hb[0].hi);
+	diff_log[0] = '\0';
+	check(jsnn_diff(a, ta, ha, same, tb, hb, diff_record, NULL) == JSNN_SUCCESS);
+	check(diff_log[0] == '\0');
+
+	/* Array order does, and "1" is not 1 */
+	jsnn_init(&p);
+	check(jsnn_parse(&p, "[[1, 2], [2, 1]]", tb, 32) == JSNN_SUCCESS);
+	check(jsnn_hash("[[1, 2], [2, 1]]", tb, p.toknext, hb) == JSNN_SUCCESS);
+	check(hb[1].lo != hb[4].lo && hb[2].lo == hb[6].lo);
+	check(jsnn_hash_scalar("1", 1, JSNN_STRING).lo
+			!= jsnn_hash_scalar("1", 1, JSNN_PRIMITIVE).lo);
+
+	jsnn_init(&p);
+	check(jsnn_parse(&p, b, tb, 32) == JSNN_SUCCESS);
+	nb = p.toknext;
+	check(jsnn_hash(b, tb, nb, hb) == JSNN_SUCCESS);
+	/* Identical subtrees hash alike, wherever they are */
+	check(ha[1].lo == hb[1].lo && ha[2].lo == hb[2].lo);
+	check(ha[0].lo != hb[0].lo);
+	diff_log[0] = '\0';
+	check(jsnn_diff(a, ta, ha, b, tb, hb, diff_record, NULL) == JSNN_SUCCESS);
+	check(strcmp(diff_log, "~tags[1] +tags[3] ~owner.id -gone +new ") == 0);
+
+	/* Keys that are not bare names are quoted, and read back */
+	a = "{\"v\": {\"a.b\": 1, \"\": 2}}";
+	b = "{\"v\": {\"a.b\": 3, \"\": 4}}";
+	jsnn_init(&p);
+	check(jsnn_parse(&p, a, ta, 32) == JSNN_SUCCESS);
+	check(jsnn_hash(a, ta, p.toknext, ha) == JSNN_SUCCESS);
+	jsnn_init(&p);
+	check(jsnn_parse(&p, b, tb, 32) == JSNN_SUCCESS);
+	check(jsnn_hash(b, tb, p.toknext, hb) == JSNN_SUCCESS);
+	diff_log[0] = '\0';
+	check(jsnn_diff(a, ta, ha, b, tb, hb, diff_record, NULL) == JSNN_SUCCESS);
+	check(strcmp(diff_log, "~v['a.b'] ~v[''] ") == 0);
+	check(jsnn_get(tb, "v['a.b']", b, tb) == &tb[4]);
+	check(jsnn_get(tb, "v['']", b, tb) == &tb[6]);
+	return 0;
+}
+
+int test_scan() {
+	const char *js =
+		"{\"user\": {\"name\": \"ann\", \"age\": 31}, \"tags\": [\"a\", \"b\"]}\n"
+		"{\"skip\": {\"user\": {\"age\": 99}}, \"user\": {\"age\": -4.5, \"name\": \"bo\"}}\n"
+		"{\"user\": {\"name\": \"ann\", \"age\": null}, \"tags\": []}\n"
+		"{\"user\" : {\"age\"\t:\n3}}\n"
+		"{\"user\": \"none\", \"tags\": [\"x\", \"]\", {\"k\": [1]}]}\n";
+	static char many[20000];
+	jsnn_path path;
+	jsnn_agg agg;
+	int i;
+
+	check(jsnn_compile(&path, "user.age") == JSNN_SUCCESS);
+	jsnn_agg_init(&agg);
+	check(jsnn_scan(js, strlen(js), &path, &agg) == JSNN_SUCCESS);
+	check(agg.records == 5);
+	check(agg.count == 3 && agg.numbers == 3);
+	check(agg.sum == 29.5 && agg.min == -4.5 && agg.max == 31);
+
+	check(jsnn_compile(&path, "user.name") == JSNN_SUCCESS);
+	jsnn_agg_init(&agg);
+	check(jsnn_scan(js, strlen(js), &path, &agg) == JSNN_SUCCESS);
+	check(agg.count == 3 && agg.numbers == 0);
+	check(jsnn_agg_distinct(&agg) > 1.5 && jsnn_agg_distinct(&agg) < 2.5);
+
+	check(jsnn_compile(&path, "tags[*]") == JSNN_SUCCESS);
+	jsnn_agg_init(&agg);
+	check(jsnn_scan(js, strlen(js), &path, &agg) == JSNN_SUCCESS);
+	check(agg.count == 5);
+	check(jsnn_compile(&path, "tags[1]") == JSNN_SUCCESS);
+	jsnn_agg_init(&agg);
+	check(jsnn_scan(js, strlen(js), &path, &agg) == JSNN_SUCCESS);
+	check(agg.count == 2);
+
+	/* Distinct counts are estimates */
+	for (i = 0; i < 1000; i++)
+		sprintf(many + strlen(many), "{\"id\": %d}\n", i % 700);
+	check(jsnn_compile(&path, "id") == JSNN_SUCCESS);
+	jsnn_agg_init(&agg);
+	check(jsnn_scan(many, strlen(many), &path, &agg) == JSNN_SUCCESS);
+	check(agg.records == 1000 && agg.max == 699);
+	check(jsnn_agg_distinct(&agg) > 650 && jsnn_agg_distinct(&agg) < 750);
+
+	check(jsnn_scan("{\"id\": [1, 2}", 13, &path, &agg) == JSNN_ERROR_PART);
+	check(jsnn_scan("{\"id\" 1}", 8, &path, &agg) == JSNN_ERROR_INVAL);
+	check(jsnn_compile(&path, "..id") == JSNN_SUCCESS);
+	check(jsnn_scan(many, strlen(many), &path, &agg) == JSNN_ERROR_INVAL);
+	return 0;
+}
+
+int test_relayout() {
+	const char *js = "{\"dogs\": [{\"name\": \"rex\", \"tags\": [\"a\", \"b\"]}, "
+		"{\"name\": \"fido\", \"age\": 4, \"owner\": {\"name\": \"ann\"}}], "
+		"\"cats\": {\"tom\": {\"age\": 9}}, \"count\": 3}";
+	const char *paths[] = { "dogs[0].name", "dogs[1].owner.name", "dogs[0].tags[1]",
+		"cats.tom.age", "count", "dogs[2]", "dogs[1].missing", "..name", "dogs[*].name",
+		"..age", "dogs[?(@.age > 3)].name", "cats.*" };
+	jsnntok_t tokens[64], relaid[64], again[64], *a[8], *b[8], *t;
+	jsnnint_t n, i, j, na, nb;
+	jsnn_parser p;
+
+	jsnn_init(&p);
+	check(jsnn_parse(&p, js, tokens, 64) == JSNN_SUCCESS);
+	n = p.toknext;
+	check(jsnn_relayout(tokens, n, relaid) == JSNN_SUCCESS);
+
+	/* Members are contiguous and follow every container breadth-first */
+	check(relaid[0].type == JSNN_OBJECT && relaid[0].key == 1);
+	check(jsnn_cmp(&relaid[1], js, "dogs") == 0 && jsnn_cmp(&relaid[3], js, "cats") == 0
+			&& jsnn_cmp(&relaid[5], js, "count") == 0);
+	check(relaid[2].type == JSNN_ARRAY && relaid[2].key == 7 && relaid[2].parent == 0);
+	check(relaid[7].parent == 2 && relaid[8].parent == 2);
+	for (i = 1; i < n; i++)
+		check(relaid[i].parent < i && relaid[i - 1].parent <= relaid[i].parent);
+
+	for (i = 0; i < (jsnnint_t)(sizeof(paths) / sizeof(paths[0])); i++) {
+		na = jsnn_query(tokens, paths[i], js, tokens, a, 8);
+		nb = jsnn_query(relaid, paths[i], js, relaid, b, 8);
+		check(na == nb);
+		for (j = 0; j < na; j++)
+			check(a[j]->start == b[j]->start && a[j]->end == b[j]->end);
+		t = jsnn_get(relaid, paths[i], js, relaid);
+		check(na > 0 ? t == b[0] : t == NULL);
+	}
+
+	check(jsnn_query(relaid, "..name", js, relaid, b, 8) == 3);
+	check(jsnn_query(relaid, "dogs[?(@.age > 3)].name", js, relaid, b, 8) == 1);
+	check(jsnn_cmp(b[0], js, "fido") == 0);
+
+	/* Re-laying out an already reordered array changes nothing */
+	check(jsnn_relayout(relaid, n, again) == JSNN_SUCCESS);
+	for (i = 0; i < n; i++)
+		check(again[i].start == relaid[i].start && again[i].parent == relaid[i].parent
+				&& again[i].key == relaid[i].key);
+	return 0;
+}
+
 int main() {
     test(test_cmp, "test convenience get and cmp functions");
     test(test_deep, "test a \"deeply\" nested JSON object");
@@ -436,6 +1234,18 @@ int main() {
 	test(test_array_nomem, "test array reading with a smaller number of tokens");
 	test(test_unquoted_keys, "test unquoted keys (like in JavaScript)");
 	test(test_objects_arrays, "test objects and arrays");
+	test(test_patch, "test patching documents by splicing token spans");
+	test(test_intern, "test key interning across parses");
+	test(test_bind, "test binding objects to C structs");
+	test(test_reparse, "test incremental re-tokenization after edits");
+	test(test_offsets, "test offset and index widths");
+	test(test_query, "test wildcard and recursive path queries");
+	test(test_filter, "test filter predicates in paths");
+	test(test_writer, "test streaming JSON writer");
+	test(test_sax, "test event-driven parsing");
+	test(test_hash_diff, "test structural hashing and diff");
+	test(test_scan, "test aggregate scans over NDJSON");
+	test(test_relayout, "test breadth-first token layout");
 	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
 	return 0;
 }
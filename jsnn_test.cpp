@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "jsnn.hpp"
+
+using namespace jsnn::literals;
+
+static int test_passed = 0;
+static int test_failed = 0;
+
+/* Terminate current test with error */
+#define fail()	return __LINE__
+
+/* Check single condition */
+#define check(cond) do { if (!(cond)) fail(); } while (0)
+
+/* Test runner */
+static void test(int (*func)(void), const char *name) {
+	int r = func();
+	if (r == 0) {
+		test_passed++;
+	} else {
+		test_failed++;
+		printf("FAILED: %s (at line %d)\n", name, r);
+	}
+}
+
+static const char *pets = "{"
+	"\"dogs\": ["
+		"{\"name\": \"spot\", \"breed\": \"terrier\", \"age\": 3},"
+		"{\"name\": \"gracie\", \"breed\": \"golden retriever\", \"age\": 7,"
+		" \"weight\": 31.5, \"good\": true}"
+	"],"
+	"\"cats\": [{\"name\": \"pickles\", \"breed\": \"sphynx\"}]"
+"}";
+
+int test_document() {
+	jsnn::document<> doc(pets);
+	check(doc.parse() == JSNN_SUCCESS);
+	check(doc.json() == pets);
+
+	jsnn::value gracie = doc.root()["dogs"][1];
+	check(gracie.is_object());
+	check(gracie["breed"].str() == "golden retriever");
+	check(gracie["age"].as_int64() == 7);
+	check(gracie["weight"].as_double() == 31.5);
+	check(gracie["good"].as_bool());
+	check(!gracie["missing"]);
+	check(!gracie["missing"]["deeper"][3]);
+	check(doc.get("dogs[0].name").str() == "spot");
+	return 0;
+}
+
+int test_compile_time_path() {
+	jsnn::document<> doc{std::string(pets)};
+	check(doc.parse() == JSNN_SUCCESS);
+	check((doc.get<"dogs"_k, 1, "breed"_k>().str() == "golden retriever"));
+	check((doc.get<"cats"_k, 0, "name"_k>().str() == "pickles"));
+	check((!doc.get<"cats"_k, 1, "name"_k>()));
+	check((doc.root()["dogs"].get<0, "age"_k>().as_int64() == 3));
+	return 0;
+}
+
+int test_iteration() {
+	jsnn::document<> doc(pets);
+	check(doc.parse() == JSNN_SUCCESS);
+
+	std::string names;
+	for (jsnn::value dog : doc.root()["dogs"])
+		names += std::string(dog["name"].str()) + ",";
+	check(names == "spot,gracie,");
+
+	std::string keys;
+	for (jsnn::value v : doc.get("dogs[1]"))
+		keys += std::string(v.key()) + ",";
+	check(keys == "name,breed,age,weight,good,");
+
+	int n = 0;
+	for (jsnn::value v : doc.get("dogs[0].name")) {
+		(void)v;
+		n++;
+	}
+	check(n == 0);
+	return 0;
+}
+
+int test_fixed_capacity() {
+	jsnn::document<8> small(pets);
+	check(small.parse() == JSNN_ERROR_NOMEM);
+
+	jsnn::document<64> fits(pets);
+	check(fits.parse() == JSNN_SUCCESS);
+	check(fits.root()["cats"].size() == 1);
+
+	/* Vector storage grows past its initial size, resuming the parse */
+	std::string big = "[";
+	for (int i = 0; i < 100; i++)
+		big += "{\"k\": " + std::to_string(i) + "},";
+	big += "{\"k\": 100}]";
+	jsnn::document<> doc(big);
+	check(doc.parse() == JSNN_SUCCESS);
+	check(doc.root().size() == 101);
+	check(doc.root()[57]["k"].as_int64() == 57);
+	return 0;
+}
+
+int main() {
+	test(test_document, "test document parsing and value access");
+	test(test_compile_time_path, "test compile-time paths");
+	test(test_iteration, "test range-for over children");
+	test(test_fixed_capacity, "test inline and growing token storage");
+	printf("\nPASSED: %d\nFAILED: %d\n", test_passed, test_failed);
+	return 0;
+}